@@ -0,0 +1,52 @@
+// compile throughput: bench/run.sh pastes this unit many times over with @
+// replaced by the copy number, so that lexing and parsing dominate the run
+
+enum { Tok@ = 128, Num@, Id@, Str@ };
+
+int count@;
+char *name@;
+
+// skip blanks and comments, return the class of the next character
+int lex@(char *p, int *pos)
+{
+    int c, n;
+
+    n = *pos;
+    while (p[n] == ' ' || p[n] == '\t' || p[n] == '\n')
+        ++n;
+    c = p[n];
+    if (c >= '0' && c <= '9') {
+        while (p[n] >= '0' && p[n] <= '9')
+            ++n;
+        *pos = n;
+        return Num@;
+    }
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+        while ((p[n] >= 'a' && p[n] <= 'z') || p[n] == '_')
+            ++n;
+        *pos = n;
+        return Id@;
+    }
+    if (c == '"') {
+        ++n;
+        while (p[n] && p[n] != '"')
+            ++n;
+        *pos = n + 1;
+        return Str@;
+    }
+    *pos = n + 1;
+    return c ? Tok@ + c : 0;
+}
+
+int sum@(int *v, int n)
+{
+    int i, s;
+
+    i = s = 0;
+    while (i < n) {
+        s = s + (v[i] * 3 + 1) % 7 - (v[i] >> 2 & 15) + sizeof(int);
+        i++;
+    }
+    count@ = count@ + 1;
+    return n > 0 ? s : -1;
+}
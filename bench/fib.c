@@ -0,0 +1,14 @@
+// call heavy: recursive fib, every call is a JSR/ENT/LEV round trip
+
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+    printf("fib(30) = %d\n", fib(30));
+    return 0;
+}
@@ -0,0 +1,54 @@
+// pointer chasing: a singly linked list of malloc'd nodes, linked in a
+// pseudo random order so that every step misses the previous cache line
+
+int main()
+{
+    int **nodes, *head, *q, n, i, j, seed, sum, pass;
+
+    n = 200000;
+    nodes = malloc(n * sizeof(int *));
+    i = 0;
+    while (i < n) {
+        nodes[i] = malloc(2 * sizeof(int));
+        nodes[i][1] = i;
+        ++i;
+    }
+
+    // Fisher-Yates shuffle with a linear congruential generator
+    seed = 12345;
+    i = n - 1;
+    while (i > 0) {
+        seed = (seed * 1103515245 + 12345) & 2147483647;
+        j = seed % (i + 1);
+        q = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = q;
+        --i;
+    }
+
+    head = 0;
+    i = 0;
+    while (i < n) {
+        *nodes[i] = (int) head;
+        head = nodes[i];
+        ++i;
+    }
+
+    sum = 0;
+    pass = 0;
+    while (pass < 10) {
+        q = head;
+        while (q) {
+            sum = sum + (q[1] & 255);
+            q = (int *) *q;
+        }
+        ++pass;
+    }
+    printf("sum %d\n", sum);
+
+    i = 0;
+    while (i < n)
+        free(nodes[i++]);
+    free(nodes);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#!/bin/sh
+# Benchmarks: build bfcc with optimization, run every bench/*.c program and a
+# generated compile throughput program, once as a single file and once split
+# into 8 translation units, under each engine and tabulate the
+# "stat" lines bfcc -v prints: lexed lines/s, emitted instructions, VM
+# cycles, cycles/s and wall time.
+#
+#   bench/run.sh [-o results] [-b baseline] [-n copies] [-r repeats]
+#
+# Each row is the fastest of -r runs (default 3). Results are written as
+# tab separated values (default bench/results.tsv).
+# With -b, every row is also compared with the same benchmark and engine in
+# an earlier results file and the change in wall time is printed.
+
+cd "$(dirname "$0")" || exit 1
+CC=${CC:-cc}
+out=results.tsv
+base=
+copies=2000
+reps=3
+while [ $# -gt 0 ]; do
+    case $1 in
+    -o) out=$2; shift ;;
+    -b) base=$2; shift ;;
+    -n) copies=$2; shift ;;
+    -r) reps=$2; shift ;;
+    *) echo "usage: bench/run.sh [-o results] [-b baseline] [-n copies] [-r repeats]"
+       exit 1 ;;
+    esac
+    shift
+done
+
+tmp=${TMPDIR:-/tmp}/bfcc-bench.$$
+mkdir -p "$tmp"
+trap 'rm -rf "$tmp"' EXIT
+
+$CC -O2 -w -pthread -o "$tmp/bfcc" ../bfcc.c || exit 1
+
+# the compile benchmark: many copies of compile.tpl and an empty main
+i=0
+while [ $i -lt $copies ]; do
+    sed "s/@/$i/g" compile.tpl
+    i=$((i + 1))
+done > "$tmp/compile.c"
+echo 'int main() { return 0; }' >> "$tmp/compile.c"
+
+# the same copies split across 8 translation units, compiled in parallel
+mkdir -p "$tmp/units"
+i=0
+while [ $i -lt $copies ]; do
+    sed "s/@/$i/g" compile.tpl >> "$tmp/units/u$((i % 8)).c"
+    i=$((i + 1))
+done
+echo 'int main() { return 0; }' >> "$tmp/units/u0.c"
+
+engines="- -t -O,-t -r -O,-r"
+[ "$(uname -m)" = x86_64 ] && engines="$engines -j -O,-j"
+
+printf 'bench\tengine\tlines\tlines/s\tinsts\tcycles\tcycles/s\twall\n' > "$tmp/res"
+for t in *.c "$tmp/compile.c" "$tmp/units"; do
+    name=$(basename "$t" .c)
+    in=$t
+    [ -d "$t" ] && in="$t/*.c --"
+    # the compile benchmarks run nothing, only the front end matters
+    modes=$engines
+    case $name in compile | units) modes="- -O" ;; esac
+    for m in $modes; do
+        args=$(echo "$m" | tr ',' ' ')
+        [ "$args" = - ] && args=
+        engine=$(echo "$m" | tr -d ',')
+        r=0
+        while [ $r -lt $reps ]; do
+            "$tmp/bfcc" -v $args $in > "$tmp/out" 2>&1
+            awk -v b="$name" -v m="$engine" '
+                $1 == "stat" && $2 == "lines" { l = $3; ls = $4 }
+                $1 == "stat" && $2 == "insts" { n = $3 }
+                $1 == "stat" && $2 == "cycles" { c = $3; cs = $4 }
+                $1 == "stat" && $2 == "wall" { w = $3 }
+                END { printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n", b, m, l, ls, n, c, cs, w }
+            ' "$tmp/out"
+            r=$((r + 1))
+        done | sort -t "$(printf '\t')" -k 8,8g | head -1 >> "$tmp/res"
+    done
+done
+cp "$tmp/res" "$out"
+cat "$out"
+
+if [ -n "$base" ]; then
+    echo
+    echo "wall time against $base:"
+    awk -F '\t' '
+        NR == FNR { w[$1 "\t" $2] = $8; next }
+        FNR > 1 && ($1 "\t" $2) in w && w[$1 "\t" $2] > 0 {
+            printf "%-10s %-6s %9.4f -> %9.4f s  %+6.1f%%\n", $1, $2,
+                w[$1 "\t" $2], $8, 100 * ($8 - w[$1 "\t" $2]) / w[$1 "\t" $2]
+        }
+    ' "$base" "$out"
+fi
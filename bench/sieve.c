@@ -0,0 +1,31 @@
+// loop and char store heavy: sieve of Eratosthenes over two million bytes
+
+int main()
+{
+    char *flags;
+    int n, i, k, count, pass;
+
+    n = 2000000;
+    flags = malloc(n);
+    pass = 0;
+    while (pass < 2) {
+        memset(flags, 1, n);
+        count = 0;
+        i = 2;
+        while (i < n) {
+            if (flags[i]) {
+                ++count;
+                k = i + i;
+                while (k < n) {
+                    flags[k] = 0;
+                    k = k + i;
+                }
+            }
+            ++i;
+        }
+        ++pass;
+    }
+    printf("%d primes below %d\n", count, n);
+    free(flags);
+    return 0;
+}
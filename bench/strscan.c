@@ -0,0 +1,35 @@
+// library call heavy: count a needle in a megabyte of text with memcmp
+// at every offset
+
+int main()
+{
+    char *buf, *needle, *word;
+    int n, i, k, len, hits;
+
+    n = 1000000;
+    buf = malloc(n);
+    word = "lorem ipsum dolor sit amet, consectetur adipiscing elit; ";
+    len = 0;
+    while (word[len])
+        ++len;
+    i = k = 0;
+    while (i < n) {
+        buf[i++] = word[k++];
+        if (k == len)
+            k = 0;
+    }
+
+    needle = "adipiscing";
+    hits = 0;
+    i = 0;
+    while (i < n - 10) {
+        if (buf[i] == 'a' && !memcmp(buf + i, needle, 10))
+            ++hits;
+        if (!memcmp(buf + i, "sit", 3))
+            ++hits;
+        ++i;
+    }
+    printf("%d hits\n", hits);
+    free(buf);
+    return 0;
+}
@@ -1,22 +1,231 @@
+#define _GNU_SOURCE  // memfd_create
 #include <fcntl.h>
 #include <memory.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
+#if defined(__GNUC__) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#endif
+#include "bfcc.h"
 
+// every int in the compiler and the VM is a pointer sized word so that
+// addresses survive the round trip through it, on ILP32 and LP64 alike
+#define int long
+
+// the compiler's state is per thread: worker threads compile translation
+// units side by side, each into segments of its own, and with -L the
+// lexer thread keeps its own copy of what it hands to the parser
+_Thread_local
 char *p, *lp,  // current position in source code
-    *data;
+    *data,     // current position in data segment
+    *dbase,    // start of the data segment
+    *dend;     // end of the data arena
 
+_Thread_local
 int *e, *le,  // current position in emitted code
     *id,      // current parsed identifier
-    *sym,     // symbol table (simple list of identifiers)
+    *cst,     // last IMM emitted for a compile-time constant
+    *call,    // last JSR emitted
+    lea,      // the current function takes the address of a local
+    *sym,     // symbol table, identifiers in the order they were first seen
+    symsz,    // number of symbol table entries
+    nsym,     // number of used symbol table entries
+    *hix,     // hash index of the symbol table, (hash, entry) pairs
+    hsz,      // number of hash index slots, a power of two
+    *scope,   // locals declared by the current function
+    *sc,      // top of the local scope stack
     tk,       // current token
     ival,     // current token value
     ty,       // current expression type
     loc,      // local variable offset
     line,     // current line number
-    src,      // print source and assembly flag
-    debug;    // print executed instructions
+    *text,    // start of the text segment
+    *tend,    // end of the text arena
+    *tline,   // source line of every word of text, while compiling
+    *tlast,   // last word of text tline covers so far
+    *ltab,    // (text index, line) of the first word of every run of
+              // words from one line, sorted, what tline is packed into
+    nltab;    // number of ltab pairs
+
+int src,      // print source and assembly flag
+    debug,    // print executed instructions
+    threaded, // run with the direct-threaded interpreter
+    regtier,  // run on the register tier
+    opt,      // optimization level
+    verbose,  // report arena usage at exit
+    profile,  // count instructions, calls and cycles per function
+    piped,    // lex on a thread of its own, ahead of the parser
+    jitted,   // translate to x86-64 and run natively
+    stksz,    // size of the VM stack
+    heapsz,   // most bytes the VM heap may map, 0 for no limit
+    slice;    // -T: cycles a task runs before it yields, 0 for no tasks
+
+// so is the running program's: with -R every runner thread compiles and
+// runs programs of its own
+_Thread_local char *jc;  // current position in jit code
+
+_Thread_local jmp_buf *onfail;  // where fail() goes, if not out of bfcc
+_Thread_local int quiet;        // don't print exit(), for library runs
+
+// what the SIGSEGV handler needs to tell a VM stack overflow from other
+// faults and to find the call it happened in: the stack the program runs
+// on, and the code the engine runs, with where it put each instruction
+_Thread_local
+char *vstk,  // low end of the VM stack, just above its guard page
+    *vend,   // high end of the VM stack
+    *xlo,    // start of the code the engine runs, text or a translation
+    *xhi,    // end of it
+    *altstk; // the thread's signal stack, the VM stack is no place for it
+
+_Thread_local
+int *xmap,  // offset of each text instruction in that code, 0 if the same
+    xunit;  // bytes per xmap unit
+
+// bytes of the signal stack each thread that runs programs sets up once
+enum { Alt = 64 * 1024 };
+
+// the running program's standard output collects in a buffer of Obuf
+// bytes, shared by printf() and write(), that goes out when full, at exit
+// or after every call under -d
+enum { Obuf = 64 * 1024 };
+
+_Thread_local char *obuf;  // output buffer of the running program
+_Thread_local int olen;    // bytes in it
+
+// the running program's heap: blocks of Hclass size classes, Hmin << k
+// bytes for class k with the class in the word before them, carved from
+// slabs of Hslab bytes, one class per slab, and blocks too large for any
+// class in a mapping of their own. Every mapping is on one list so that
+// the whole heap goes back at once when the program ends.
+enum { Hmin = 16, Hclass = 9, Hslab = 64 * 1024 };
+
+_Thread_local
+int *hlist[Hclass],  // free blocks of each class, linked through word 0
+    *hbump[Hclass],  // next unused block of each class's current slab
+    *hlim[Hclass],   // end of that slab
+    *hmaps,          // mappings of the heap, see hmap()
+    hmapped,         // bytes mapped
+    hcap,            // most bytes the heap may map, 0 for no limit
+    hlive,           // bytes in blocks in use
+    hpeak,           // most bytes ever in use at once
+    hmax,            // most bytes ever mapped at once
+    hcount[Hclass + 1];  // allocations per class, then of large blocks
+
+// -T: words a suspended task keeps its heap in, see hswap()
+enum { Hsave = 4 * Hclass + 6 };
+
+// -T: a task, a program run as a green thread, Tsz words: its VM registers
+// while it is suspended, the cycles it may run before it next yields, the
+// code run() translated it into, its stack, data segment and heap cap, the
+// program, whether the task frees it, where its exit status goes, the next
+// task on the run queue and then its heap
+enum { Tpc, Tsp, Tbp, Ta, Tcycle, Tslice, Tcode, Tstk, Tstksz, Tdbase, Tcap,
+       Tprog, Town, Texit, Tnext, Theap, Tsz = Theap + Hsave };
+
+// -T: a scheduler, Qsz words: its run queue, tasks linked through Tnext
+// from the head to the tail, how many tasks have not ended yet and the
+// slice, the cycles each runs before it yields to the next
+enum { Qhead, Qtail, Qlive, Qslice, Qsz };
+
+pthread_mutex_t qlock = PTHREAD_MUTEX_INITIALIZER;  // every run queue
+pthread_cond_t qcond = PTHREAD_COND_INITIALIZER;    // one was added to
+
+_Thread_local int *task;  // -T: the task run() runs, 0 if none
+
+// -L: tokens travel from the lexer thread to the parser through a ring of
+// Ring (tk, ival, id or string length, line) records. Each side publishes
+// its count under llock every Lbatch records or when it has to wait.
+enum { Ring = 4096, Lbatch = 256 };
+
+int *lring,  // -L: token records
+    lhead,   // -L: records produced, as published by the lexer
+    ltail,   // -L: records consumed, as published by the parser
+    lseen,   // -L: records the parser knows are there
+    lnext;   // -L: next record the parser consumes
+
+pthread_mutex_t llock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t lcond = PTHREAD_COND_INITIALIZER;
+
+// translation units, Usz words each: the file, and once a worker has
+// compiled it the unit's segments, symbol table and lines, then where
+// linkall() places its text and data and how it maps its globals. With
+// -R they are whole programs and only Ufile and Uexit are used.
+enum { Ufile, Utext, Ue, Udbase, Udata, Usym, Unsym, Uline, Utline, Utoff,
+       Udoff, Umap, Uexit, Usz };
+
+int *units,  // translation units, or programs with -R
+    nunit,   // number of translation units
+    ujob,    // next unit a worker picks up, under ulock
+    pool;    // -R: runner threads
+
+pthread_mutex_t ulock = PTHREAD_MUTEX_INITIALIZER;
+
+char cls[256];  // class of every character, see Cskip
+int lone[256],  // token of an operator character on its own
+    twice[256], // token of an operator character doubled, like ++
+    witheq[256];  // token of an operator character followed by =
+
+_Thread_local
+int *pcount,  // -p: executions per opcode
+    *pfn,     // -p: function number + 1 of each text index that is an entry
+    *pent,    // -p: entry of each function as a text index
+    *pcalls,  // -p: calls per function
+    *pself,   // -p: cycles spent in the function itself
+    *ptotal,  // -p: cycles including callees, recursion counted once
+    *pdepth,  // -p: active calls per function
+    *pstk,    // -p: shadow call stack of (caller, cycle at entry)
+    *psp,     // -p: top of the shadow call stack
+    psz,      // -p: bytes of the shadow call stack
+    nfn,      // -p: number of functions
+    pcur;     // -p: function currently executing
+
+char *pjson;  // -P: write the profile as JSON to this file
+
+// -F: call stacks sampled every Stick microseconds of CPU time, counted in
+// Sslot slots of Ssz words: how often the stack was seen, its depth and
+// up to Sdepth frames, innermost first, each a byte offset into the code
+// the engine runs. A stack goes into the slot its hash picks or one of the
+// Sprobe after it, so that a sample costs bounded time.
+enum { Stick = 1000, Sslot = 8192, Sprobe = 32, Sdepth = 62, Ssz = Sdepth + 2 };
+
+char *pfold;  // -F: write the sampled stacks, folded, to this file
+
+_Thread_local
+int *sbuf,     // -F: the stack slots, 0 when not sampling
+    *sroot,    // -F: entry of main
+    nsample,   // -F: samples taken
+    sdrop,     // -F: samples lost for want of a slot
+    shost[2];  // -F -j: bp and text index of the last call into the host
+
+_Thread_local volatile int stick;  // -F: run() takes a sample when it can
+
+_Thread_local
+int *rtext,  // -r: register code
+    *re,     // -r: end of the register code
+    *rend,   // -r: end of the register code area
+    *rmap,   // -r: offset of each text instruction in the register code
+    *rlast,  // -r: last instruction, if it computed the accumulator
+    *rk,     // -r: where each expression stack entry is (Vreg, Vimm, ...)
+    *rv,     // -r: its register, immediate or address offset
+    ak,      // -r: where the accumulator is
+    av,      // -r: its register, immediate or address offset
+    rdep,    // -r: expression stack depth
+    rloc;    // -r: locals of the function being translated
+
+int nline;  // -v: source lines lexed
+
+_Thread_local int ncycle;  // -v: instructions executed by the interpreters
+
+double tstart,  // -v: wall clock when bfcc started
+    tparse,     // -v: seconds spent lexing and parsing
+    trun;       // -v: seconds spent running the program
 
 // clang-format off
 // tokens and classes (operators last and in precedence order)
@@ -28,12 +237,20 @@ enum {
 // clang-format on
 
 // clang-format off
-// opcodes
+// opcodes (the ones before LEV take an operand)
 enum {
-    LEA, IMM, JMP, JSR, BZ, BNZ, ENT, ADJ, LEV, LI, LC, SI, SC, PSH, 
+    LEA, IMM, JMP, JSR, BZ, BNZ, BEQ, BNE, BLT, BGT, BLE, BGE,
+    ENT, ADJ, ADDI, MULI, SHLI, LLI, LLC, ADDP, LEAG, TAIL, TSR, LEV, LI, LC, SI, SC, PSH,
     OR, XOR, AND, EQ, NE, LT, GT, LE, GE, SHL, SHR, ADD, SUB, MUL, DIV, MOD, 
-    OPEN, READ, CLOS, PRTF, MALC, FREE, MSET, MCMP, EXIT
+    OPEN, READ, CLOS, WRIT, PRTF, MALC, FREE, MSET, MCMP, EXIT
 };
+
+// opcode names for -s and -d, five characters per entry
+char *ops =
+    "LEA ,IMM ,JMP ,JSR ,BZ  ,BNZ ,BEQ ,BNE ,BLT ,BGT ,BLE ,BGE ,"
+    "ENT ,ADJ ,ADDI,MULI,SHLI,LLI ,LLC ,ADDP,LEAG,TAIL,TSR ,LEV ,LI  ,LC  ,SI  ,SC  ,PSH ,"
+    "OR  ,XOR ,AND ,EQ  ,NE  ,LT  ,GT  ,LE  ,GE  ,SHL ,SHR ,ADD ,SUB ,MUL ,DIV ,MOD ,"
+    "OPEN,READ,CLOS,WRIT,PRTF,MALC,FREE,MSET,MCMP,EXIT,";
 // clang-format on
 
 // clang-format off
@@ -48,53 +265,519 @@ enum {
 };
 // clang-format on
 
-void next()
+// clang-format off
+// character classes of the lexer, Fid marks the characters that continue
+// an identifier
+enum { Cskip, Cblank, Cnl, Chash, Cid, Cdigit, Cslash, Cquote, Cop, Fid = 16 };
+
+// what scan() looks for: the end of a run of blanks, of a line, of an
+// identifier, of decimal digits, or the next quote, backslash or end of a
+// string literal
+enum { Sblank, Seol, Sid, Sdigit, Squote };
+
+// vector width and operations for scan(), AVX2 or SSE2 when the compiler
+// targets them
+#if defined(__GNUC__) && defined(__AVX2__)
+#define VW          32
+#define VBITS       0xffffffffu
+#define vec         __m256i
+#define vload(s)    _mm256_load_si256((vec *) (s))
+#define vset(c)     _mm256_set1_epi8(c)
+#define veq(a, b)   _mm256_cmpeq_epi8(a, b)
+#define vgt(a, b)   _mm256_cmpgt_epi8(a, b)
+#define vor(a, b)   _mm256_or_si256(a, b)
+#define vand(a, b)  _mm256_and_si256(a, b)
+#define vmask(v)    (unsigned) _mm256_movemask_epi8(v)
+#elif defined(__GNUC__) && defined(__SSE2__)
+#define VW          16
+#define VBITS       0xffffu
+#define vec         __m128i
+#define vload(s)    _mm_load_si128((vec *) (s))
+#define vset(c)     _mm_set1_epi8(c)
+#define veq(a, b)   _mm_cmpeq_epi8(a, b)
+#define vgt(a, b)   _mm_cmpgt_epi8(a, b)
+#define vor(a, b)   _mm_or_si128(a, b)
+#define vand(a, b)  _mm_and_si128(a, b)
+#define vmask(v)    (unsigned) _mm_movemask_epi8(v)
+#endif
+// clang-format on
+
+// write out the running program's buffered output, after whatever the
+// host has buffered in stdio
+void oflush()
 {
-    char *pp;
+    int n, k;
 
-    while (tk = *p) {
-        ++p;
-        if (tk == '\n') {
-            if (src) {
-                printf("%d: %.*s", line, p - lp, lp);
-                lp = p;
-                while (le < e) {
-                    printf("%8.4s", &"LEA ,IMM ,JMP ,JSR ,BZ  ,BNZ ,ENT ,ADJ ,LEV ,LI  ,LC  ,SI  ,SC  ,PSH ,"
-                           "OR  ,XOR ,AND ,EQ  ,NE  ,LT  ,GT  ,LE  ,GE  ,SHL ,SHR ,ADD ,SUB ,MUL ,DIV ,MOD ,"
-                           "OPEN,READ,CLOS,PRTF,MALC,FREE,MSET,MCMP,EXIT,"[*++le * 5]);
-                    if (*le <= ADJ)
-                        printf(" %d\n", *++le);
-                    else
-                        printf("\n");
+    fflush(stdout);
+    n = 0;
+    while (n < olen && (k = write(1, obuf + n, olen - n)) > 0) {
+        n = n + k;
+    }
+    olen = 0;
+}
+
+// the program's write(): standard output goes through the buffer, other
+// files straight to the kernel
+int owrite(int fd, char *s, int n)
+{
+    if (fd != 1 || !obuf) {
+        return write(fd, s, n);
+    }
+    if (n > Obuf - olen) {
+        oflush();
+        if (n >= Obuf) {
+            return write(1, s, n);
+        }
+    }
+    memcpy(obuf + olen, s, n);
+    olen = olen + n;
+    if (debug) {
+        oflush();
+    }
+    return n;
+}
+
+// the program's printf(), formatted straight into the buffer
+int oformat(char *f, int a, int b, int c, int d, int g)
+{
+    int n;
+
+    if (!obuf) {
+        return printf(f, a, b, c, d, g);
+    }
+    n = snprintf(obuf + olen, Obuf - olen, f, a, b, c, d, g);
+    if (n >= Obuf - olen) {
+        oflush();
+        if (n >= Obuf) {
+            return dprintf(1, f, a, b, c, d, g);
+        }
+        n = snprintf(obuf, Obuf, f, a, b, c, d, g);
+    }
+    if (n > 0) {
+        olen = olen + n;
+    }
+    if (debug) {
+        oflush();
+    }
+    return n;
+}
+
+// copy the format f to w, which has room for twice as much, with an l
+// added to every integer conversion without one: the program's printf()
+// formats words, and %d must print all of one
+void widen(char *f, char *w)
+{
+    while ((*w++ = *f)) {
+        if (*f++ != '%') {
+            continue;
+        }
+        if (*f == '%') {
+            *w++ = *f++;
+            continue;
+        }
+        while (*f && strchr("-+ #.*0123456789", *f)) {
+            *w++ = *f++;
+        }
+        if (*f && strchr("diouxX", *f)) {
+            *w++ = 'l';
+        }
+    }
+}
+
+// the program's printf()
+int oprintf(char *f, int a, int b, int c, int d, int g)
+{
+    char w[256], *h;
+    int n;
+
+    n = strlen(f);
+    if ((h = 2 * n < sizeof(w) ? w : malloc(2 * n + 1))) {
+        widen(f, h);
+        f = h;
+    }
+    n = oformat(f, a, b, c, d, g);
+    if (h && h != w) {
+        free(h);
+    }
+    return n;
+}
+
+// give up on the program at hand after its error has been printed: back
+// to the -R runner that took it on, or out of bfcc
+void fail()
+{
+    if (obuf) {
+        oflush();
+        free(obuf);
+        obuf = 0;
+    }
+    if (onfail) {
+        longjmp(*onfail, 1);
+    }
+    exit(-1);
+}
+
+// map sz bytes for the heap, headed by the links of the list of mappings
+// and the size: next, previous, size, and a word for the caller. Taking
+// the heap past its cap is an error of the program, running out of memory
+// is not and returns 0.
+int *hmap(int sz)
+{
+    int *m;
+
+    sz = (sz + 4095) & -4096;
+    if (hcap && hmapped + sz > hcap) {
+        printf("heap cap of %ld bytes reached\n", hcap);
+        fail();
+    }
+    m = mmap(0, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+             0);
+    if (m == MAP_FAILED) {
+        return 0;
+    }
+    m[0] = (int) hmaps;
+    m[1] = 0;
+    m[2] = sz;
+    if (hmaps) {
+        hmaps[1] = (int) m;
+    }
+    hmaps = m;
+    hmapped = hmapped + sz;
+    if (hmapped > hmax) {
+        hmax = hmapped;
+    }
+    return m;
+}
+
+void hunmap(int *m)
+{
+    if (m[1]) {
+        ((int *) m[1])[0] = m[0];
+    } else {
+        hmaps = (int *) m[0];
+    }
+    if (m[0]) {
+        ((int *) m[0])[1] = m[1];
+    }
+    hmapped = hmapped - m[2];
+    munmap(m, m[2]);
+}
+
+// the program's malloc(): the first free block of the size class, or the
+// next one of its slab
+char *vmalloc(int n)
+{
+    int *b, k;
+
+    if (n < 0) {
+        return 0;
+    }
+    k = 0;
+    while (k < Hclass && Hmin << k < n + sizeof(int)) {
+        ++k;
+    }
+    if (k == Hclass) {
+        // large: its mapping's header word is the class, -1
+        if (!(b = hmap(n + 4 * sizeof(int)))) {
+            return 0;
+        }
+        b[3] = -1;
+        b = b + 4;
+        hlive = hlive + b[-2];
+    } else {
+        if ((b = hlist[k])) {
+            hlist[k] = (int *) *b;
+        } else {
+            if (!hbump[k] || (char *) hbump[k] + (Hmin << k) >
+                                 (char *) hlim[k]) {
+                if (!(b = hmap(Hslab))) {
+                    return 0;
                 }
+                hbump[k] = b + 3;
+                hlim[k] = (int *) ((char *) b + Hslab);
             }
-            ++line;
-        } else if (tk == '#') {
-            while (*p != '\0' && *p != '\n')
-                ++p;
-        } else if ((tk >= 'a' && tk <= 'z') || (tk >= 'A' && tk <= 'Z') ||
-                   tk == '_') {
+            b = hbump[k] + 1;
+            b[-1] = k;
+            hbump[k] = (int *) ((char *) hbump[k] + (Hmin << k));
+        }
+        hlive = hlive + (Hmin << k);
+    }
+    if (hlive > hpeak) {
+        hpeak = hlive;
+    }
+    ++hcount[k];
+    return (char *) b;
+}
+
+// the program's free(): onto the free list of the block's class, a large
+// block's mapping straight back
+void vfree(char *p)
+{
+    int *b, k;
+
+    if (!(b = (int *) p)) {
+        return;
+    }
+    k = b[-1];
+    if (k < 0) {
+        hlive = hlive - b[-2];
+        hunmap(b - 4);
+        return;
+    }
+    *b = (int) hlist[k];
+    hlist[k] = b;
+    hlive = hlive - (Hmin << k);
+}
+
+// a fresh heap for the next program; the statistics of the last one stay
+// until then for -v
+void hinit()
+{
+    memset(hlist, 0, sizeof(hlist));
+    memset(hbump, 0, sizeof(hbump));
+    memset(hlim, 0, sizeof(hlim));
+    memset(hcount, 0, sizeof(hcount));
+    hmaps = 0;
+    hmapped = hlive = hpeak = hmax = 0;
+}
+
+// the program has ended: its whole heap goes back, whatever it freed
+void hrelease()
+{
+    while (hmaps) {
+        hunmap(hmaps);
+    }
+}
+
+// exchange the n words at a with those at b
+void wswap(int *a, int *b, int n)
+{
+    int k;
+
+    while (n-- > 0) {
+        k = *a;
+        *a++ = *b;
+        *b++ = k;
+    }
+}
+
+// -T: exchange the running program's heap with the one kept at h, Hsave
+// words, when a task starts or stops running on the thread. The cap is
+// the task's own, see Tcap.
+void hswap(int *h)
+{
+    wswap((int *) hlist, h, Hclass);
+    wswap((int *) hbump, h + Hclass, Hclass);
+    wswap((int *) hlim, h + 2 * Hclass, Hclass);
+    wswap(hcount, h + 3 * Hclass, Hclass + 1);
+    wswap((int *) &hmaps, h + 4 * Hclass + 1, 1);
+    wswap(&hmapped, h + 4 * Hclass + 2, 1);
+    wswap(&hlive, h + 4 * Hclass + 3, 1);
+    wswap(&hpeak, h + 4 * Hclass + 4, 1);
+    wswap(&hmax, h + 4 * Hclass + 5, 1);
+}
+
+// (re)build the hash index of the symbol table with n slots. The entries
+// themselves never move, so pointers to them stay valid.
+void rehash(int n)
+{
+    int *h, *d;
+
+    free(hix);
+    if (!(hix = malloc(n * 2 * sizeof(int)))) {
+        printf("could not malloc(%ld) symbol index\n", n * 2 * sizeof(int));
+        fail();
+    }
+    memset(hix, 0, n * 2 * sizeof(int));
+    hsz = n;
+    d = sym;
+    while (d < sym + nsym * Idsz) {
+        h = hix + ((d[Hash] ^ d[Hash] >> 10) & (hsz - 1)) * 2;
+        while (h[1]) {
+            h = h + 2;
+            if (h == hix + hsz * 2) {
+                h = hix;
+            }
+        }
+        h[0] = d[Hash];
+        h[1] = (int) d;
+        d = d + Idsz;
+    }
+}
+
+// fill the character class and operator tables
+void lexinit()
+{
+    int i;
+    char *s;
+
+    i = 0;
+    while (i < 256) {
+        if ((i >= 'a' && i <= 'z') || (i >= 'A' && i <= 'Z') || i == '_') {
+            cls[i] = Cid | Fid;
+        } else if (i >= '0' && i <= '9') {
+            cls[i] = Cdigit | Fid;
+        }
+        ++i;
+    }
+    cls[' '] = cls['\t'] = cls['\r'] = Cblank;
+    cls['\n'] = Cnl;
+    cls['#'] = Chash;
+    cls['/'] = Cslash;
+    cls['\''] = cls['"'] = Cquote;
+
+    s = "=+-!<>|&^%*[?~;{}()],:";
+    while (*s) {
+        cls[*s & 255] = Cop;
+        lone[*s & 255] = *s;
+        ++s;
+    }
+    lone['='] = Assign;
+    lone['+'] = Add;
+    lone['-'] = Sub;
+    lone['<'] = Lt;
+    lone['>'] = Gt;
+    lone['|'] = Or;
+    lone['&'] = And;
+    lone['^'] = Xor;
+    lone['%'] = Mod;
+    lone['*'] = Mul;
+    lone['['] = Brak;
+    lone['?'] = Cond;
+    twice['='] = Eq;
+    twice['+'] = Inc;
+    twice['-'] = Dec;
+    twice['<'] = Shl;
+    twice['>'] = Shr;
+    twice['|'] = Lor;
+    twice['&'] = Lan;
+    witheq['<'] = Le;
+    witheq['>'] = Ge;
+    witheq['!'] = Ne;
+}
+
+#ifdef VW
+// bit i set for every byte i of the aligned block at s that ends the scan
+unsigned stops(char *s, int k, int q)
+{
+    vec v, m, l;
+
+    v = vload(s);
+    if (k == Sblank) {
+        return ~vmask(vor(veq(v, vset(' ')), veq(v, vset('\t')))) & VBITS;
+    } else if (k == Seol) {
+        return vmask(vor(veq(v, vset('\n')), veq(v, vset(0))));
+    } else if (k == Squote) {
+        m = vor(veq(v, vset(q)), veq(v, vset('\\')));
+        return vmask(vor(m, veq(v, vset(0))));
+    }
+    // bytes of 0x80 and up compare as negative and end both runs
+    m = vand(vgt(v, vset('0' - 1)), vgt(vset('9' + 1), v));
+    if (k == Sid) {
+        l = vor(v, vset(0x20));
+        l = vand(vgt(l, vset('a' - 1)), vgt(vset('z' + 1), l));
+        m = vor(vor(m, l), veq(v, vset('_')));
+    }
+    return ~vmask(m) & VBITS;
+}
+#endif
+
+// whether character c ends a scan of kind k
+int stop1(int c, int k, int q)
+{
+    if (k == Sblank) {
+        return c != ' ' && c != '\t';
+    } else if (k == Seol) {
+        return !c || c == '\n';
+    } else if (k == Sid) {
+        return !(cls[c & 255] & Fid);
+    } else if (k == Sdigit) {
+        return c < '0' || c > '9';
+    }
+    return !c || c == q || c == '\\';
+}
+
+// first character at or after s where a scan of kind k stops. Most runs
+// are short, so the first few characters are looked at one by one before
+// the vector loop takes over. The vector loop only loads aligned blocks,
+// which never cross into the guard page behind the source, and every kind
+// stops at the terminating NUL.
+char *scan(char *s, int k, int q)
+{
+#ifdef VW
+    char *a;
+    unsigned m;
+
+    a = s + 8;
+    while (s < a) {
+        if (stop1(*s, k, q)) {
+            return s;
+        }
+        ++s;
+    }
+    a = (char *) ((int) s & -VW);
+    m = stops(a, k, q) >> (s - a);
+    if (m) {
+        return s + __builtin_ctz(m);
+    }
+    while (!(m = stops(a = a + VW, k, q))) {
+    }
+    return a + __builtin_ctz(m);
+#else
+    while (!stop1(*s, k, q)) {
+        ++s;
+    }
+    return s;
+#endif
+}
+
+void lex()
+{
+    char *pp, *q;
+    int c, *h;
+
+    while (tk = *p) {
+        ++p;
+        c = cls[tk & 255];
+        if (c == (Cid | Fid)) {
             pp = p - 1;
-            while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
-                   (*p >= '0' && *p <= '9') || *p == '_')
-                tk = tk * 147 + *p++;
+            p = scan(p, Sid, 0);
+            q = pp + 1;
+            while (q < p) {
+                tk = tk * 147 + *q++;
+            }
             tk = (tk << 6) + (p - pp);
-            id = sym;
-            while (id[Tk]) {
-                if (tk == id[Hash] && !memcmp((char *) id[Name], pp, p - pp)) {
+            // linear probing from the slot picked by the hash
+            h = hix + ((tk ^ tk >> 10) & (hsz - 1)) * 2;
+            while (h[1]) {
+                id = (int *) h[1];
+                if (tk == *h && !memcmp((char *) id[Name], pp, p - pp)) {
                     tk = id[Tk];
                     return;
                 }
-                id = id + Idsz;
+                h = h + 2;
+                if (h == hix + hsz * 2) {
+                    h = hix;
+                }
+            }
+            if (nsym == symsz) {
+                printf("%ld: too many identifiers\n", line);
+                fail();
             }
+            id = sym + nsym++ * Idsz;
             id[Name] = (int) pp;
-            id[Hash] = tk;
+            h[0] = id[Hash] = tk;
+            h[1] = (int) id;
             tk = id[Tk] = Id;
+            if (nsym > hsz / 2) {
+                rehash(hsz * 2);
+            }
             return;
-        } else if (tk >= '0' && tk <= '9') {
+        } else if (c == (Cdigit | Fid)) {
             if (ival = tk - '0') {
                 // 10进制
-                while (*p >= '0' && *p <= '()') {
+                q = scan(p, Sdigit, 0);
+                while (p < q) {
                     ival = ival * 10 + *p++ - '0';
                 }
             } else if (*p == 'x' || *p == 'X') {
@@ -112,31 +795,79 @@ void next()
             }
             tk = Num;
             return;
-        } else if (tk == '/') {
+        } else if (c == Cblank) {
+            p = scan(p, Sblank, 0);
+        } else if (c == Cop) {
+            if (twice[tk] && *p == tk) {
+                // == ++ -- << >> || &&
+                tk = twice[tk];
+                ++p;
+            } else if (witheq[tk] && *p == '=') {
+                // <= >= !=
+                tk = witheq[tk];
+                ++p;
+            } else {
+                tk = lone[tk];
+            }
+            return;
+        } else if (c == Cnl) {
+            if (src) {
+                printf("%ld: %.*s", line, (signed) (p - lp), lp);
+                lp = p;
+                while (le < e) {
+                    printf("%8.4s", &ops[*++le * 5]);
+                    if (*le < LEV)
+                        printf(" %ld\n", *++le);
+                    else
+                        printf("\n");
+                }
+            }
+            ++line;
+        } else if (c == Chash) {
+            p = scan(p, Seol, 0);
+        } else if (c == Cslash) {
             if (*p == '/') {
                 // 注释
-                ++p;
-                while (*p != '\0' && *p != '\n')
-                    ++p;
+                p = scan(p + 1, Seol, 0);
             } else {
                 // 除号
                 tk = Div;
                 return;
             }
-        } else if (tk == '\'' || tk == '"') {
+        } else if (c == Cquote) {
             // 保存data起始位置
             pp = data;
             while (*p != '\0' && *p != tk) {
-                if ((ival = *p++) == '\\') {
+                if (tk == '"') {
+                    // copy up to the next quote, backslash or end at once
+                    q = scan(p, Squote, tk);
+                    if (q - p > dend - data) {
+                        printf("%ld: data segment full\n", line);
+                        fail();
+                    }
+                    memcpy(data, p, q - p);
+                    data = data + (q - p);
+                    if (*(p = q) != '\\') {
+                        continue;
+                    }
+                }
+                if ((ival = *p++) == '\\' && *p) {
                     // \n
                     if ((ival = *p++) == 'n')
                         ival = '\n';
                 }
                 // 字符串
-                if (tk == '"')
+                if (tk == '"') {
+                    if (data >= dend) {
+                        printf("%ld: data segment full\n", line);
+                        fail();
+                    }
                     *data++ = ival;
+                }
+            }
+            if (*p) {
+                ++p;
             }
-            ++p;
             if (tk == '"') {
                 ival = (int) pp;
             } else {
@@ -144,147 +875,211 @@ void next()
                 tk = Num;
             }
             return;
-        } else if (tk == '=') {
-            if (*p == '=') {
-                // ==
-                ++p;
-                tk = Eq;
-            } else {
-                // =
-                tk = Assign;
-            }
-            return;
-        } else if (tk == '+') {
-            if (*p == '+') {
-                // ++
-                ++p;
-                tk = Inc;
-            } else {
-                // +
-                tk = Add;
-            }
-            return;
-        } else if (tk == '-') {
-            if (*p == '-') {
-                // --
-                ++p;
-                tk = Dec;
-            } else {
-                // -
-                tk = Sub;
-            }
-            return;
-        } else if (tk == '!') {
-            if (*p == '=') {
-                // !=
-                ++p;
-                tk = Ne;
-            }
-            return;
-        } else if (tk == '<') {
-            if (*p == '=') {
-                // <=
-                ++p;
-                tk = Le;
-            } else if (*p == '<') {
-                // <<
-                ++p;
-                tk = Shl;
-            } else {
-                // <
-                tk = Lt;
-            }
-            return;
-        } else if (tk == '>') {
-            if (*p == '=') {
-                // >=
-                ++p;
-                tk = Ge;
-            } else if (*p == '>') {
-                // >>
-                ++p;
-                tk = Shr;
-            } else {
-                // >
-                tk = Gt;
-            }
-            return;
-        } else if (tk == '|') {
-            if (*p == '|') {
-                // 逻辑或 ||
-                ++p;
-                tk = Lor;
-            } else {
-                // |
-                tk = Or;
-            }
-            return;
-        } else if (tk == '&') {
-            if (*p == '&') {
-                // 逻辑与 &&
-                ++p;
-                tk = Lan;
-            } else {
-                // 与运算 &
-                tk = And;
-            }
-            return;
-        } else if (tk == '^') {
-            // 异或运算 ^
-            tk = Xor;
-            return;
-        } else if (tk == '%') {
-            // 取余数 %
-            tk = Mod;
-            return;
-        } else if (tk == '*') {
-            // *
-            tk = Mul;
-            return;
-        } else if (tk == '[') {
-            // [
-            tk = Brak;
-            return;
-        } else if (tk == '?') {
-            tk = Cond;
-            return;
-        } else if (tk == '~' || tk == ';' || tk == '{' || tk == '}' ||
-                   tk == '(' || tk == ')' || tk == ']' || tk == ',' ||
-                   tk == ':') {
-            return;
         }
     }
 }
 
 
-void expr(int lev)
+// -L: the lexer thread. It resolves identifiers against the shared symbol
+// table, which only it inserts into and whose entries never move, so the
+// parser sees the same entry for a name no matter how far ahead the lexer
+// is; scopes shadow and restore locals in place on the entries. String
+// literals go to a 64 MB area of their own until the parser copies them.
+// l holds that area, then the parser thread's p, sym, symsz, nsym, hix and
+// hsz, and gets nsym, hix and hsz back when the lexer is done.
+void *lexer(void *arg)
 {
-    int t, *d;
+    int n, m, *r, *l;
 
-    if (!tk) {
-        printf("%d: unexpected eof in expression\n", line);
-        exit(-1);
-    } else if (tk == Num) {
-        *++e = IMM;
-        *++e = ival;
-        next();
-        ty = INT;
-    } else if (tk == '"') {
-        *++e = IMM;
-        *++e = ival;
-        next();
-        while (tk == '"')
-            next();
-        data = (char *) ((int) data + sizeof(int) & -sizeof(int));
-        ty = PTR;
-    } else if (tk == Sizeof) {
-        next();
+    l = arg;
+    data = (char *) l[0];
+    dend = data + 64 * 1024 * 1024;
+    p = (char *) l[1];
+    sym = (int *) l[2];
+    symsz = l[3];
+    nsym = l[4];
+    hix = (int *) l[5];
+    hsz = l[6];
+    line = 1;
+    n = m = 0;  // produced, and consumed as far as the lexer knows
+    do {
+        lex();
+        if (n - m == Ring) {
+            pthread_mutex_lock(&llock);
+            lhead = n;
+            pthread_cond_signal(&lcond);
+            while (n - ltail == Ring) {
+                pthread_cond_wait(&lcond, &llock);
+            }
+            m = ltail;
+            pthread_mutex_unlock(&llock);
+        }
+        r = lring + (n & (Ring - 1)) * 4;
+        r[0] = tk;
+        r[1] = ival;
+        r[2] = tk == '"' ? (int) data - ival : (int) id;
+        r[3] = line;
+        if (!(++n % Lbatch) || !tk) {
+            pthread_mutex_lock(&llock);
+            lhead = n;
+            m = ltail;
+            pthread_cond_signal(&lcond);
+            pthread_mutex_unlock(&llock);
+        }
+    } while (tk);
+    l[4] = nsym;
+    l[5] = (int) hix;
+    l[6] = hsz;
+    return 0;
+}
+
+// the code emitted since the last call comes from the current line. The
+// parser emits a construct once the token after it is current, so next()
+// calls this before it moves on.
+void tsync()
+{
+    if (tlast > e) {
+        tlast = e;  // fold() or an enum initializer took code back
+    }
+    while (tlast < e) {
+        tline[++tlast - text] = line;
+    }
+}
+
+// the next token, from the lexer thread with -L. A string literal is
+// copied into the data segment only now, so that it lands exactly where
+// the serial lexer would have put it between the parser's own globals.
+void next()
+{
+    int *r;
+
+    tsync();
+    if (!lring) {
+        lex();
+        return;
+    }
+    if (lnext == lseen) {
+        pthread_mutex_lock(&llock);
+        ltail = lnext;
+        pthread_cond_signal(&lcond);
+        while (lhead == lnext) {
+            pthread_cond_wait(&lcond, &llock);
+        }
+        lseen = lhead;
+        pthread_mutex_unlock(&llock);
+    }
+    r = lring + (lnext & (Ring - 1)) * 4;
+    tk = r[0];
+    ival = r[1];
+    line = r[3];
+    if (tk == '"') {
+        if (r[2] > dend - data) {
+            printf("%ld: data segment full\n", line);
+            fail();
+        }
+        memcpy(data, (char *) ival, r[2]);
+        ival = (int) data;
+        data = data + r[2];
+    } else {
+        id = (int *) r[2];
+    }
+    // eof stays the current token however often it is asked for
+    if (tk && !(++lnext % Lbatch)) {
+        pthread_mutex_lock(&llock);
+        ltail = lnext;
+        pthread_cond_signal(&lcond);
+        pthread_mutex_unlock(&llock);
+    }
+}
+
+// fold "IMM x; PSH; IMM y; op" into a single IMM when both immediates are
+// compile-time constants, c points at the IMM of the left operand
+void fold(int *c)
+{
+    int x, y, op;
+
+    if (!c || e != c + 5 || cst != c + 3) {
+        return;
+    }
+    x = c[1];
+    y = c[4];
+    op = *e;
+    // leave division by zero, and the least word over -1, which does not
+    // fit, to the runtime
+    if ((op == DIV || op == MOD) &&
+        (!y || (y == -1 && x == (int) (~(unsigned int) 0 / 2 + 1)))) {
+        return;
+    }
+    if (op == OR) {
+        x = x | y;
+    } else if (op == XOR) {
+        x = x ^ y;
+    } else if (op == AND) {
+        x = x & y;
+    } else if (op == EQ) {
+        x = x == y;
+    } else if (op == NE) {
+        x = x != y;
+    } else if (op == LT) {
+        x = x < y;
+    } else if (op == GT) {
+        x = x > y;
+    } else if (op == LE) {
+        x = x <= y;
+    } else if (op == GE) {
+        x = x >= y;
+    } else if (op == SHL) {
+        x = x << y;
+    } else if (op == SHR) {
+        x = x >> y;
+    } else if (op == ADD) {
+        x = x + y;
+    } else if (op == SUB) {
+        x = x - y;
+    } else if (op == MUL) {
+        x = x * y;
+    } else if (op == DIV) {
+        x = x / y;
+    } else if (op == MOD) {
+        x = x % y;
+    } else {
+        return;
+    }
+    e = c + 1;
+    *e = x;
+    cst = c;
+}
+
+void expr(int lev)
+{
+    int t, *d, *c;
+
+    if (!tk) {
+        printf("%ld: unexpected eof in expression\n", line);
+        fail();
+    } else if (tk == Num) {
+        *++e = IMM;
+        *++e = ival;
+        cst = e - 1;
+        next();
+        ty = INT;
+    } else if (tk == '"') {
+        // data addresses are emitted relative to the data segment
+        *++e = LEAG;
+        *++e = ival - (int) dbase;
+        next();
+        while (tk == '"')
+            next();
+        data = (char *) ((int) data + sizeof(int) & -sizeof(int));
+        ty = PTR;
+    } else if (tk == Sizeof) {
+        next();
         // sizeof后边一定是个括号，否则就是词法解析错误
         if (tk == '(') {
             next();
         } else {
-            printf("%d: open paren expected in sizeof\n", line);
-            exit(-1);
+            printf("%ld: open paren expected in sizeof\n", line);
+            fail();
         }
         ty = INT;
         if (tk == Int) {
@@ -300,9 +1095,13 @@ void expr(int lev)
         if (tk == ')') {
             next();
         } else {
-            printf("%d: close paren expected in sizeof\n", line);
-            exit(-1);
+            printf("%ld: close paren expected in sizeof\n", line);
+            fail();
         }
+        *++e = IMM;
+        *++e = (ty == CHAR) ? sizeof(char) : sizeof(int);
+        cst = e - 1;
+        ty = INT;
     } else if (tk == Id) {
         d = id;
         next();
@@ -327,32 +1126,40 @@ void expr(int lev)
                 // function call
                 *++e = JSR;
                 *++e = d[Val];
+                call = e - 1;
+            } else if (!d[Class]) {
+                // defined later or in another unit: the JSR points at the
+                // symbol entry until link() or resolve() finds the function
+                *++e = JSR;
+                *++e = (int) d;
+                call = e - 1;
             } else {
-                printf("%d: bad function call\n", line);
-                exit(-1);
+                printf("%ld: bad function call\n", line);
+                fail();
             }
             // clean the stack for arguments
             if (t) {
                 *++e = ADJ;
                 *++e = t;
             }
-            ty = d[Type];
+            ty = d[Class] ? d[Type] : INT;
         } else if (d[Class] == Num) {
             // enum
             *++e = IMM;
             *++e = d[Val];
+            cst = e - 1;
             ty = INT;
         } else {
             // variable
-            if (d[Class] = Loc) {
+            if (d[Class] == Loc) {
                 *++e = LEA;
                 *++e = loc - d[Val];
             } else if (d[Class] == Glo) {
-                *++e = IMM;
+                *++e = LEAG;
                 *++e = d[Val];
             } else {
-                printf("%d: undefined variable\n", line);
-                exit(-1);
+                printf("%ld: undefined variable\n", line);
+                fail();
             }
             ty = d[Type];
             // 如果type是CHAR，则将将对应的地址中的字符载入ax中，
@@ -372,8 +1179,8 @@ void expr(int lev)
             if (tk == ')') {
                 next();
             } else {
-                printf("%d: bad case\n", line);
-                exit(-1);
+                printf("%ld: bad case\n", line);
+                fail();
             }
             expr(Inc);  // case跟++有同样的优先级
             ty = t;
@@ -383,8 +1190,8 @@ void expr(int lev)
             if (tk == ')') {
                 next();
             } else {
-                printf("%d: close paren expected\n", line);
-                exit(-1);
+                printf("%ld: close paren expected\n", line);
+                fail();
             }
         }
     } else if (tk == Mul) {
@@ -394,8 +1201,8 @@ void expr(int lev)
         if (ty > INT) {
             ty = ty - PTR;
         } else {
-            printf("%d: bad dereference\n", line);
-            exit(-1);
+            printf("%ld: bad dereference\n", line);
+            fail();
         }
         *++e = (ty == CHAR) ? LC : LI;
     } else if (tk == And) {
@@ -405,25 +1212,36 @@ void expr(int lev)
         if (*e == LC || *e == LI) {
             --e;
         } else {
-            printf("%d: bad addredd-of\n", line);
-            exit(-1);
+            printf("%ld: bad addredd-of\n", line);
+            fail();
+        }
+        if (e[-1] == LEA) {
+            lea = 1;
         }
         ty = ty + PTR;
     } else if (tk == '!') {
         next();
         expr(Inc);
-        *++e = PSH;
-        *++e = IMM;
-        *++e = 0;
-        *++e = EQ;
+        if (e == cst + 1) {
+            *e = !*e;
+        } else {
+            *++e = PSH;
+            *++e = IMM;
+            *++e = 0;
+            *++e = EQ;
+        }
         ty = INT;
     } else if (tk == '~') {
         next();
         expr(Inc);
-        *++e = PSH;
-        *++e = IMM;
-        *++e = -1;
-        *++e = XOR;
+        if (e == cst + 1) {
+            *e = ~*e;
+        } else {
+            *++e = PSH;
+            *++e = IMM;
+            *++e = -1;
+            *++e = XOR;
+        }
         ty = INT;
     } else if (tk == Add) {
         next();
@@ -431,14 +1249,13 @@ void expr(int lev)
         ty = INT;
     } else if (tk == Sub) {
         next();
-        *++e = IMM;
-        if (tk == Num) {
-            *++e = -ival;
-            next();
+        expr(Inc);
+        if (e == cst + 1) {
+            *e = -*e;
         } else {
-            *++e = -1;
             *++e = PSH;
-            expr(Inc);
+            *++e = IMM;
+            *++e = -1;
             *++e = MUL;
         }
         ty = INT;
@@ -454,8 +1271,8 @@ void expr(int lev)
             *e = PSH;
             *++e = LI;
         } else {
-            printf("%d: bad lvalue in pre-increment\n", line);
-            exit(-1);
+            printf("%ld: bad lvalue in pre-increment\n", line);
+            fail();
         }
 
         *++e = PSH;
@@ -464,20 +1281,21 @@ void expr(int lev)
         *++e = (t == Inc) ? ADD : SUB;
         *++e = (ty == CHAR) ? SC : SI;
     } else {
-        printf("%d: bad expression\n", line);
-        exit(-1);
+        printf("%ld: bad expression\n", line);
+        fail();
     }
 
     // binary
     while (tk >= lev) {
         t = ty;
+        c = (e == cst + 1) ? cst : 0;  // left operand is a constant
         if (tk == Assign) {
             next();
             if (*e == LC || *e == LI) {
                 *e = PSH;
             } else {
-                printf("%d: bad lvalue in assignment\n", line);
-                exit(-1);
+                printf("%ld: bad lvalue in assignment\n", line);
+                fail();
             }
             expr(Assign);
             ty = t;
@@ -491,20 +1309,28 @@ void expr(int lev)
             if (tk == ':') {
                 next();
             } else {
-                printf("%d: conditional missing colon\n", line);
-                exit(-1);
+                printf("%ld: conditional missing colon\n", line);
+                fail();
             }
             *d = (int) (e + 3);
             *++e = JMP;
             d = ++e;
             expr(Cond);
             *d = (int) (e + 1);
+            cst = 0;
         } else if (tk == Lor) {
             next();
             *++e = BNZ;
             d = ++e;
             expr(Lan);
             *d = (int) (e + 1);
+            if (c && e == c + 5 && cst == c + 4) {
+                c[1] = c[1] ? c[1] : c[5];
+                e = c + 1;
+                cst = c;
+            } else {
+                cst = 0;
+            }
             ty = INT;
         } else if (tk == Lan) {
             next();
@@ -512,84 +1338,107 @@ void expr(int lev)
             d = ++e;
             expr(Or);
             *d = (int) (e + 1);
+            if (c && e == c + 5 && cst == c + 4) {
+                c[1] = c[1] ? c[5] : c[1];
+                e = c + 1;
+                cst = c;
+            } else {
+                cst = 0;
+            }
             ty = INT;
         } else if (tk == Or) {
             next();
             *++e = PSH;
             expr(Xor);
             *++e = OR;
+            fold(c);
             ty = INT;
         } else if (tk == Xor) {
             next();
             *++e = PSH;
             expr(And);
             *++e = XOR;
+            fold(c);
             ty = INT;
         } else if (tk == And) {
             next();
             *++e = PSH;
             expr(Eq);
             *++e = AND;
+            fold(c);
             ty = INT;
         } else if (tk == Eq) {
             next();
             *++e = PSH;
             expr(Lt);
             *++e = EQ;
+            fold(c);
             ty = INT;
         } else if (tk == Ne) {
             next();
             *++e = PSH;
             expr(Lt);
             *++e = NE;
+            fold(c);
             ty = INT;
         } else if (tk == Lt) {
             next();
             *++e = PSH;
             expr(Shl);
             *++e = LT;
+            fold(c);
             ty = INT;
         } else if (tk == Gt) {
             next();
             *++e = PSH;
             expr(Shl);
             *++e = GT;
+            fold(c);
             ty = INT;
         } else if (tk == Le) {
             next();
             *++e = PSH;
             expr(Shl);
             *++e = LE;
+            fold(c);
             ty = INT;
         } else if (tk == Ge) {
             next();
             *++e = PSH;
             expr(Shl);
             *++e = GE;
+            fold(c);
             ty = INT;
         } else if (tk == Shl) {
             next();
             *++e = PSH;
             expr(Add);
             *++e = SHL;
+            fold(c);
             ty = INT;
         } else if (tk == Shr) {
             next();
             *++e = PSH;
             expr(Add);
             *++e = SHR;
+            fold(c);
             ty = INT;
         } else if (tk == Add) {
             next();
             *++e = PSH;
             expr(Mul);
             if ((ty = t) > PTR) {
-                *++e = PSH;
-                *++e = IMM;
-                *++e = sizeof(int);
-                *++e = MUL;
+                if (e == cst + 1) {
+                    *e = *e * sizeof(int);
+                } else {
+                    *++e = PSH;
+                    *++e = IMM;
+                    *++e = sizeof(int);
+                    *++e = MUL;
+                }
             }
             *++e = ADD;
+            fold(c);
         } else if (tk == Sub) {
             next();
             *++e = PSH;
@@ -602,42 +1451,50 @@ void expr(int lev)
                 *++e = DIV;
                 ty = INT;
             } else if ((ty = t) > PTR) {
-                *++e = PSH;
-                *++e = IMM;
-                *++e = sizeof(int);
-                *++e = MUL;
+                if (e == cst + 1) {
+                    *e = *e * sizeof(int);
+                } else {
+                    *++e = PSH;
+                    *++e = IMM;
+                    *++e = sizeof(int);
+                    *++e = MUL;
+                }
                 *++e = SUB;
             } else {
                 *++e = SUB;
+                fold(c);
             }
         } else if (tk == Mul) {
             next();
             *++e = PSH;
             expr(Inc);
             *++e = MUL;
+            fold(c);
             ty = INT;
         } else if (tk == Div) {
             next();
             *++e = PSH;
             expr(Inc);
             *++e = DIV;
+            fold(c);
             ty = INT;
         } else if (tk == Mod) {
             next();
             *++e = PSH;
             expr(Inc);
             *++e = MOD;
+            fold(c);
             ty = INT;
         } else if (tk == Inc || tk == Dec) {
             if (*e == LC) {
                 *e = PSH;
                 *++e = LC;
-            } else if (*e = LI) {
+            } else if (*e == LI) {
                 *e = PSH;
                 *++e = LI;
             } else {
-                printf("%d: bad lvalue in post-increment\n", line);
-                exit(-1);
+                printf("%ld: bad lvalue in post-increment\n", line);
+                fail();
             }
             *++e = PSH;
             *++e = IMM;
@@ -656,45 +1513,61 @@ void expr(int lev)
             if (tk == ']') {
                 next();
             } else {
-                printf("%d: close bracket expected\n", line);
-                exit(-1);
+                printf("%ld: close bracket expected\n", line);
+                fail();
             }
             if (t > PTR) {
-                *++e = PSH;
-                *++e = IMM;
-                *++e = sizeof(int);
-                *++e = MUL;
+                if (e == cst + 1) {
+                    *e = *e * sizeof(int);
+                } else {
+                    *++e = PSH;
+                    *++e = IMM;
+                    *++e = sizeof(int);
+                    *++e = MUL;
+                }
             } else if (t < PTR) {
-                printf("%d: pointer type expected\n", line);
-                exit(-1);
+                printf("%ld: pointer type expected\n", line);
+                fail();
             }
             *++e = ADD;
             *++e = ((ty = t - PTR) == CHAR) ? LC : LI;
         } else {
-            printf("%d: compiler error tk = %d\n", line, tk);
-            exit(-1);
+            printf("%ld: compiler error tk = %ld\n", line, tk);
+            fail();
         }
     }
 }
 
+// the text and data arenas are not checked on every store, make sure a
+// statement or declaration has plenty of room before compiling it
+void room()
+{
+    if (e + 64 * 1024 > tend || data + 64 * 1024 > dend) {
+        printf("%ld: program too large\n", line);
+        fail();
+    }
+}
+
 void stmt()
 {
-    int *a, *b;
+    int *a, *b, *c, i, nb, nc;
+
+    room();
     if (tk == If) {
         // if () ...
         next();
         if (tk == '(') {
             next();
         } else {
-            printf("%d: open paren expected\n", line);
-            exit(-1);
+            printf("%ld: open paren expected\n", line);
+            fail();
         }
         expr(Assign);
         if (tk == ')') {
             next();
         } else {
-            printf("%d: close paren expected\n", line);
-            exit(-1);
+            printf("%ld: close paren expected\n", line);
+            fail();
         }
         *++e = BZ;
         b = ++e;
@@ -715,40 +1588,90 @@ void stmt()
         if (tk == '(') {
             next();
         } else {
-            printf("%d: open paren expected\n", line);
-            exit(-1);
+            printf("%ld: open paren expected\n", line);
+            fail();
         }
         expr(Assign);
         if (tk == ')') {
             next();
         } else {
-            printf("%d: close paren expected\n", line);
-            exit(-1);
+            printf("%ld: close paren expected\n", line);
+            fail();
         }
         *++e = BZ;
         b = ++e;
         stmt();
-        *++e = JMP;
-        *++e = (int) a;
-        *b = (int) (e + 1);
+
+        // test at the bottom: the condition C, BZ, body B becomes JMP to C,
+        // B, C, BNZ to B, one branch per iteration instead of two. Branches
+        // into C and B move with them, those to the BZ now land on the BNZ
+        // and those to the end of B on the start of C.
+        room();
+        nc = b - 1 - a;
+        nb = e - b;
+        c = a;
+        while (c <= e) {
+            i = *c++;
+            if (i == JMP || i == JSR || i == TSR || i == BZ || i == BNZ) {
+                if ((int *) *c >= a && (int *) *c < b) {
+                    *c = (int) ((int *) *c + nb + 2);
+                } else if ((int *) *c > b && (int *) *c <= e + 1) {
+                    *c = (int) ((int *) *c - nc);
+                }
+            }
+            if (i < LEV) {
+                ++c;
+            }
+        }
+        // the lines move with the code, the JMP and BNZ are the condition's
+        tsync();
+        c = tline + (a - text);
+        memcpy(c + nc + 2 + nb, c, nc * sizeof(int));
+        memmove(c + 2, c + nc + 2, nb * sizeof(int));
+        memcpy(c + 2 + nb, c + nc + 2 + nb, nc * sizeof(int));
+        c[1] = c[nb + nc + 2] = c[nb + nc + 3] = c[0];
+        memcpy(e + 1, a, nc * sizeof(int));
+        memmove(a + 2, b + 1, nb * sizeof(int));
+        memcpy(a + 2 + nb, e + 1, nc * sizeof(int));
+        a[0] = JMP;
+        a[1] = (int) (a + 2 + nb);
+        e = a + 1 + nb + nc;
+        *++e = BNZ;
+        *++e = (int) (a + 2);
+        tlast = e;
+        cst = call = 0;
     } else if (tk == Return) {
         next();
         if (tk != ';') {
             expr(Assign);
+            // return f(...): when the arguments fit where this function's
+            // parameters are, JSR; ADJ n becomes TAIL n; TSR, which moves
+            // them there, drops this frame and jumps to f. Not if the
+            // frame may still be pointed into, after &x of a local x.
+            if (!lea && call == e - 1) {
+                *call = TSR;
+            } else if (!lea && call == e - 3 && e[-1] == ADJ &&
+                       *e <= loc - 1) {
+                call[0] = TAIL;
+                call[2] = call[3];
+                call[3] = call[1];
+                call[1] = call[2];
+                call[2] = TSR;
+            }
         }
         *++e = LEV;
         if (tk == ';') {
             next();
         } else {
-            printf("%d: semicolon expected\n", line);
-            exit(-1);
+            printf("%ld: semicolon expected\n", line);
+            fail();
         }
     } else if (tk == '{') {
         next();
         while (tk != '}') {
             stmt();
-            next();
         }
+        next();
     } else if (tk == ';') {
         next();
     } else {
@@ -756,155 +1679,1093 @@ void stmt()
         if (tk == ';') {
             next();
         } else {
-            printf("%d: semicolon expected\n", line);
-            exit(-1);
+            printf("%ld: semicolon expected\n", line);
+            fail();
         }
     }
 }
 
-int main(int argc, char *argv[])
+// -O: between the parser and peep() every function goes through a second
+// form, basic blocks of expression trees rebuilt from the stack code
+// expr() and stmt() emitted for it. The passes over the trees drop the
+// blocks nothing branches to, like the code after a return, stores to
+// locals that are never read again, recompute no expression twice within
+// a block and lift expressions that do not change in a while loop out of
+// it. The function is then emitted anew from the trees. -O0 keeps the
+// code the parser emitted as it is.
+
+// clang-format off
+// tree nodes, Nsz words each: an opcode, its operand, the left and right
+// operands, or for calls the argument list and its length, the next
+// node on a list of lifted stores and the line of the code it was built
+// from, 0 for one the passes made. Two pseudo ops stand for what is in a
+// already: Ain its value on entry to the block, Again the value last
+// pushed, which a load of it reads without computing it again.
+enum { Nop, Nval, Nl, Nr, Nn, Nln, Nsz };
+enum { Ain = EXIT + 1, Again };
+
+// basic blocks, Bsz words each: where the block started in the parsed
+// code, its statements as an index into nstm and a count, the tree whose
+// value it leaves in a, how it ends (0 for falling through, JMP, BZ, BNZ,
+// LEV or TSR), the called function of a TSR, the blocks it goes on to
+// (-1 for none), the arguments of a TSR and their number, whether it
+// reads a on entry, whether it is reachable, the locals alive on entry and
+// exit, the stores lifted into it and where it is emitted
+enum { Bpc, Bs, Bn, Blast, Bt, Bval, Bto, Bfall, Bargs, Bnargs, Bain, Breach,
+       Bin, Bout, Bh, Bnew, Bsz };
+// clang-format on
+
+_Thread_local
+int *nbuf,   // -O: nodes and argument lists of the function
+    *nfree,  // -O: next free word in nbuf
+    *nlim,   // -O: end of nbuf, less room for one rewrite
+    *nstm,   // -O: statements of every block, kept for their effects
+    nnstm,   // -O: number of statements
+    *blk,    // -O: basic blocks
+    nblk,    // -O: number of basic blocks
+    nloc,    // -O: locals of the function, new temporaries included
+    nesc,    // -O: slot bits of the locals whose address is taken
+    nlive,   // -O: slot bits of the locals alive, see dead()
+    nmem,    // -O: 1 when a tree reads memory, 2 when it divides
+    *ne,     // -O: last word of the code emitted from the trees
+    ndead,   // -O: stores removed
+    ncse,    // -O: expressions not computed again
+    nhoist,  // -O: expressions lifted out of loops
+    nat,     // -O: line of the instruction build() is at
+    *olin,   // -O: line of every word of the code lower() emits
+    *oz;     // -O: last word of that code olin covers
+
+// a new node in nbuf
+int *node(int op, int v, int l, int r)
 {
-    int fd, bt, ty, poolsz, *idmain;
+    int *n;
 
-    // vm registers
-    int *pc,  // 程序计数器
-        *sp,  // 指针寄存器
-        *bp,  // 基址指针
-        a,    // ax 通用寄存器
-        cycle;
+    n = nfree;
+    nfree = nfree + Nsz;
+    n[Nop] = op;
+    n[Nval] = v;
+    n[Nl] = l;
+    n[Nr] = r;
+    n[Nn] = 0;
+    n[Nln] = nat;
+    return n;
+}
 
-    int i, *t;
+// a copy of node n, sharing its operands
+int *ncopy(int *n)
+{
+    int *c;
 
-    // 第一个参数是程序本身
-    --argc;
-    ++argv;
+    c = node(n[Nop], n[Nval], n[Nl], n[Nr]);
+    c[Nln] = n[Nln];
+    return c;
+}
 
-    // -s
-    if (argc > 0 && **argv == '-' && (*argv)[1] == 's') {
-        src = 1;
-        --argc;
-        ++argv;
-    }
+// bit of the local at offset v from bp, LEA v, in a set of slots. Locals
+// and parameters interleave so that both get bits, those that run out of
+// bits are not tracked and get 0.
+int sbit(int v)
+{
+    int k;
 
-    // -d
-    if (argc > 0 && **argv == '-' && (*argv)[1] == 'd') {
-        debug = 1;
-        --argc;
-        ++argv;
-    }
+    k = v < 0 ? -2 * v - 2 : 2 * v - 3;
+    return v == 0 || v == 1 || k >= sizeof(int) * 8 - 1 ? 0 : (int) 1 << k;
+}
 
-    if (argc < 1) {
-        printf("usage: bfcc [-s] [-d] file ...\n");
-        return -1;
-    }
+// its bit in the sets the passes work on, 0 if its address is taken too
+int slot(int v)
+{
+    return sbit(v) & ~nesc;
+}
 
-    if ((fd = open(*argv, 0)) < 0) {
-        printf("could not open(%s)\n", *argv);
-        return -1;
+int iscall(int i)
+{
+    return i == JSR || (i >= OPEN && i <= EXIT);
+}
+
+// whether evaluating n does anything but compute a value, a division
+// counting for the trap a zero divisor would be
+int effect(int *n)
+{
+    int i;
+
+    i = n[Nop];
+    if (i == SI || i == SC || i == DIV || i == MOD || iscall(i)) {
+        return 1;
+    } else if (i == LI || i == LC) {
+        return effect((int *) n[Nl]);
+    } else if (i >= OR && i <= MOD) {
+        return effect((int *) n[Nl]) || effect((int *) n[Nr]);
     }
+    return 0;
+}
 
-    poolsz = 256 * 1024;
-    if (!(sym = malloc(poolsz))) {
-        printf("could not malloc(%d) symbol area\n", poolsz);
-        return -1;
+// whether tree t has node n in it
+int holds(int *t, int *n)
+{
+    int i, k;
+
+    if (t == n) {
+        return 1;
     }
-    if (!(le = e = malloc(poolsz))) {
-        printf("could not malloc(%d) text area\n", poolsz);
-        return -1;
+    i = t[Nop];
+    if (i == LI || i == LC) {
+        return holds((int *) t[Nl], n);
+    } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+        return holds((int *) t[Nl], n) || holds((int *) t[Nr], n);
+    } else if (iscall(i)) {
+        k = 0;
+        while (k < t[Nr]) {
+            if (holds(((int **) t[Nl])[k++], n)) {
+                return 1;
+            }
+        }
     }
-    if (!(data = malloc(poolsz))) {
-        printf("could not malloc(%d) data area\n", poolsz);
-        return -1;
+    return 0;
+}
+
+// whether n reads a value pushed outside tree t
+int stray(int *n, int *t)
+{
+    int i, k;
+
+    i = n[Nop];
+    if (i == Again) {
+        return !holds(t, (int *) n[Nl]);
+    } else if (i == LI || i == LC) {
+        return stray((int *) n[Nl], t);
+    } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+        return stray((int *) n[Nl], t) || stray((int *) n[Nr], t);
+    } else if (iscall(i)) {
+        k = 0;
+        while (k < n[Nr]) {
+            if (stray(((int **) n[Nl])[k++], t)) {
+                return 1;
+            }
+        }
     }
-    if (!(sp = malloc(poolsz))) {
-        printf("could not malloc(%d) stack area\n", poolsz);
-        return -1;
+    return 0;
+}
+
+// the part of n with effects, for when its value goes unused: what x++
+// leaves over from x = x + 1 and the arithmetic around a call
+int *discard(int *n)
+{
+    int i, *l, *r;
+
+    i = n[Nop];
+    while ((i >= OR && i < DIV) || i == LI || i == LC) {
+        l = (int *) n[Nl];
+        r = i == LI || i == LC ? l : (int *) n[Nr];
+        if (!effect(l) && !stray(r, r)) {
+            n = r;
+        } else if (!effect(r) && !stray(l, l)) {
+            n = l;
+        } else {
+            break;
+        }
+        i = n[Nop];
     }
+    return n;
+}
 
-    memset(sym, 0, poolsz);
-    memset(e, 0, poolsz);
-    memset(data, 0, poolsz);
+// number of nodes in a tree without calls
+int cost(int *n)
+{
+    int i;
 
-    p = "char else enum if int return sizeof while"
-        "open read close printf malloc free memset memcmp exit void main";
+    i = n[Nop];
+    if (i == LI || i == LC) {
+        return 1 + cost((int *) n[Nl]);
+    } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+        return 1 + cost((int *) n[Nl]) + cost((int *) n[Nr]);
+    }
+    return 1;
+}
 
-    // add keywords to symbol table
-    i = Char;
-    while (i <= While) {
-        next();
-        id[Tk] = i++;
+// whether two trees without calls or stores compute the same
+int same(int *a, int *b)
+{
+    int i;
+
+    i = a[Nop];
+    if (i != b[Nop] || a[Nval] != b[Nval]) {
+        return 0;
+    } else if (i == LI || i == LC) {
+        return same((int *) a[Nl], (int *) b[Nl]);
+    } else if (i >= OR && i <= MOD) {
+        return same((int *) a[Nl], (int *) b[Nl]) &&
+               same((int *) a[Nr], (int *) b[Nr]);
     }
+    return i == LEA || i == IMM || i == LEAG;
+}
 
-    // add library to symbol table
-    i = OPEN;
-    while (i <= EXIT) {
-        next();
-        id[Class] = Sys;
-        id[Type] = INT;
-        id[Val] = i++;
+// slot bits of the locals n reads, or -1 if n does more than compute a
+// value from locals, memory and constants. Adds to nmem what it reads.
+int reads(int *n)
+{
+    int i, l, r;
+
+    i = n[Nop];
+    if (i == IMM || i == LEAG) {
+        return 0;
+    } else if (i == LI || i == LC) {
+        l = n[Nl];
+        if (((int *) l)[Nop] == LEA) {
+            return (r = slot(((int *) l)[Nval])) ? r : -1;
+        }
+        nmem = nmem | 1;
+        return reads((int *) l);
+    } else if (i >= OR && i <= MOD) {
+        if (i == DIV || i == MOD) {
+            nmem = nmem | 2;
+        }
+        l = reads((int *) n[Nl]);
+        r = reads((int *) n[Nr]);
+        return l < 0 || r < 0 ? -1 : l | r;
     }
+    return -1;
+}
 
-    next();
-    id[Tk] = Char;  // handle void type
-    next();
-    idmain = id;  // keep track of main
+// a new temporary local, its LEA operand
+int temp()
+{
+    return -++nloc;
+}
 
-    if (!(lp = p = malloc(poolsz))) {
-        printf("could not malloc(%d) source area\n", poolsz);
-        return -1;
+// the value in a at the end of a block of the stack code, 0 if there is
+// none: the block started with something else than a read of a
+int *take(int *b, int *a, int fresh)
+{
+    if (a) {
+        return a;
+    } else if (fresh) {
+        b[Bain] = 1;
+        return node(Ain, 0, 0, 0);
     }
+    return 0;
+}
 
-    if ((i = read(fd, p, poolsz - 1)) <= 0) {
-        printf("read() returned %d\n", i);
-        return -1;
+// keep the tree a was computing as a statement when a is written again,
+// if it has effects. Returns 0 if it would be evaluated out of order,
+// after the values on the stack that were computed before it.
+int keep(int *a, int sp)
+{
+    if (a && effect(a)) {
+        if (sp) {
+            return 0;
+        }
+        nstm[nnstm++] = (int) a;
     }
+    return 1;
+}
 
-    // add eof character
-    p[i] = '\0';
-    close(fd);
+// turn the code from the ENT at f to e into basic blocks of trees.
+// Returns 0 for code that does not fit: a value left on the stack across
+// a branch, as in x = c ? a : b, or a pushed value read again by anything
+// but a load, or code peep() already fused.
+int build(int *f, int *bix, int *stk)
+{
+    int *c, *b, *a, *x, *end, i, k, n, sp, fresh, pushed;
 
-    // parse declarations
-    line = 1;
-    next();
-    while (tk) {
-        bt = INT;  // basetype
-        if (tk == Int) {
-            next();
-        } else if (tk == Char) {
-            next();
-            bt = CHAR;
-        } else if (tk == Enum) {
-            next();
-            if (tk != '{') {
-                // enum name
-                next();
+    c = f + 2;
+    bix[2] = 1;
+    while (c <= e) {
+        i = *c;
+        if (i == ENT || (i >= BEQ && i <= BGE) || (i >= ADDI && i <= ADDP)) {
+            return 0;
+        }
+        if (i == JMP || i == BZ || i == BNZ) {
+            if ((int *) c[1] < f + 2 || (int *) c[1] > e) {
+                return 0;
             }
-            if (tk == '{') {
-                next();
-                i = 0;
-                while (tk != '}') {
-                    if (tk != Id) {
-                        printf("%d: bad enum identifier %d\n", line, tk);
-                        return -1;
-                    }
-                    next();
-                    if (tk == Assign) {
-                        next();
-                        if (tk != Num) {
-                            printf("%d: bad enum initializer\n", line);
-                            return -1;
-                        }
-                        i = ival;
-                        next();
-                    }
-                    id[Class] = Num;
-                    id[Type] = INT;
-                    id[Val] = i++;
-                    if (tk == ',') {
-                        next();
-                    }
+            bix[(int *) c[1] - f] = 1;
+        }
+        c = c + (i < LEV ? 2 : 1);
+        if (i == JMP || i == BZ || i == BNZ || i == LEV || i == TSR) {
+            bix[c - f] = 1;
+        }
+    }
+    nblk = 0;
+    k = 2;
+    while (k <= e - f) {
+        if (bix[k]) {
+            b = blk + nblk * Bsz;
+            memset(b, 0, Bsz * sizeof(int));
+            b[Bpc] = (int) (f + k);
+            bix[k] = ++nblk;
+        }
+        ++k;
+    }
+
+    k = 0;
+    while (k < nblk) {
+        b = blk + k * Bsz;
+        c = (int *) b[Bpc];
+        end = k + 1 < nblk ? (int *) b[Bpc + Bsz] : e + 1;
+        b[Bs] = nnstm;
+        b[Bto] = b[Bfall] = -1;
+        sp = pushed = 0;
+        fresh = 1;
+        a = 0;
+        while (c < end) {
+            i = *c;
+            nat = tline[c - text];
+            if (i == LEA || i == IMM || i == LEAG) {
+                if (!keep(a, sp)) {
+                    return 0;
                 }
-                next();
+                a = node(i, c[1], 0, 0);
+            } else if (i == LI || i == LC) {
+                if (pushed) {
+                    x = node(Again, 0, stk[sp - 1], 0);
+                } else if (!(x = take(b, a, fresh))) {
+                    return 0;
+                }
+                a = node(i, 0, (int) x, 0);
+            } else if (i == PSH) {
+                if (pushed || !(x = take(b, a, fresh))) {
+                    return 0;
+                }
+                stk[sp++] = (int) x;
+                a = 0;
+            } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+                if (pushed || !sp || !(x = take(b, a, fresh))) {
+                    return 0;
+                }
+                a = node(i, 0, stk[--sp], (int) x);
+            } else if (iscall(i)) {
+                x = c + (i == JSR ? 2 : 1);
+                n = x < end && *x == ADJ ? x[1] : 0;
+                if (n > sp || (n && !pushed) || (!n && !keep(a, sp))) {
+                    return 0;
+                }
+                sp = sp - n;
+                x = nfree;
+                nfree = nfree + n;
+                memcpy(x, stk + sp, n * sizeof(int));
+                a = node(i, i == JSR ? c[1] : 0, (int) x, n);
+                c = c + (i == JSR ? 2 : 1) + (n ? 2 : 0);
+                pushed = fresh = 0;
+                continue;
+            } else if (i == JMP) {
+                b[Bto] = bix[(int *) c[1] - f] - 1;
+            } else if (i == BZ || i == BNZ || i == LEV) {
+                if (pushed || !(a = take(b, a, fresh))) {
+                    return 0;
+                }
+                if (i != LEV) {
+                    b[Bto] = bix[(int *) c[1] - f] - 1;
+                    b[Bfall] = k + 1;
+                }
+            } else if (i == TAIL || i == TSR) {
+                n = i == TAIL ? c[1] : 0;
+                if (n != sp || (n && !pushed) || (!n && !keep(a, sp))) {
+                    return 0;
+                }
+                if (i == TAIL) {
+                    c = c + 2;
+                }
+                b[Bval] = c[1];
+                b[Bargs] = (int) nfree;
+                b[Bnargs] = n;
+                memcpy(nfree, stk, n * sizeof(int));
+                nfree = nfree + n;
+                sp = 0;
+                a = 0;
+                i = TSR;
+            } else {
+                return 0;
+            }
+            if (i == JMP || i == BZ || i == BNZ || i == LEV || i == TSR) {
+                b[Bt] = i;
+            }
+            pushed = i == PSH;
+            fresh = 0;
+            c = c + (i < LEV ? 2 : 1);
+        }
+        if (sp || pushed) {
+            return 0;
+        }
+        if (!b[Bt]) {
+            b[Bfall] = k + 1;
+        }
+        b[Blast] = (int) a;
+        b[Bn] = nnstm - b[Bs];
+        ++k;
+    }
+    return 1;
+}
+
+// whether block b has to leave its value in a: it branches on it or
+// returns it, or a block it goes on to reads it
+int needed(int *b)
+{
+    return b[Bt] == BZ || b[Bt] == BNZ || b[Bt] == LEV ||
+           (b[Bto] >= 0 && blk[b[Bto] * Bsz + Bain]) ||
+           (b[Bfall] >= 0 && blk[b[Bfall] * Bsz + Bain]);
+}
+
+// mark the locals whose address n takes, n the address of a load or a
+// store if addr
+void escape(int *n, int addr)
+{
+    int i, k;
+
+    i = n[Nop];
+    if (i == LEA) {
+        if (!addr) {
+            nesc = nesc | sbit(n[Nval]);
+        }
+    } else if (i == LI || i == LC) {
+        escape((int *) n[Nl], 1);
+    } else if (i == SI || i == SC) {
+        escape((int *) n[Nl], 1);
+        escape((int *) n[Nr], 0);
+    } else if (i >= OR && i <= MOD) {
+        escape((int *) n[Nl], 0);
+        escape((int *) n[Nr], 0);
+    } else if (iscall(i)) {
+        k = 0;
+        while (k < n[Nr]) {
+            escape(((int **) n[Nl])[k++], 0);
+        }
+    }
+}
+
+// walk n backwards in the order it runs, from the locals alive after it
+// in nlive to those alive before it. With cut, a store to a local that is
+// not alive after it turns into the value it stores.
+void dead(int *n, int cut)
+{
+    int i, k, *l;
+
+    i = n[Nop];
+    l = (int *) n[Nl];
+    if (i == SI && l[Nop] == LEA && (k = slot(l[Nval]))) {
+        if (cut && !(nlive & k) && !stray((int *) n[Nr], (int *) n[Nr])) {
+            memcpy(n, (int *) n[Nr], Nsz * sizeof(int));
+            ++ndead;
+            dead(n, cut);
+            return;
+        }
+        nlive = nlive & ~k;
+        dead((int *) n[Nr], cut);
+    } else if (i == LI || i == LC) {
+        if (l[Nop] == Again && ((int *) l[Nl])[Nop] == LEA) {
+            l = (int *) l[Nl];
+        }
+        if (l[Nop] == LEA) {
+            nlive = nlive | slot(l[Nval]);
+        } else {
+            dead(l, cut);
+        }
+    } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+        dead((int *) n[Nr], cut);
+        dead(l, cut);
+    } else if (iscall(i)) {
+        k = n[Nr];
+        while (k > 0) {
+            dead(((int **) n[Nl])[--k], cut);
+        }
+    }
+}
+
+// the locals alive on entry to block b, from those alive on exit
+int alivein(int *b, int cut)
+{
+    int k;
+
+    nlive = b[Bout];
+    k = b[Bnargs];
+    while (k > 0) {
+        dead(((int **) b[Bargs])[--k], cut);
+    }
+    if (b[Blast]) {
+        dead((int *) b[Blast], cut);
+    }
+    k = b[Bn];
+    while (k > 0) {
+        dead((int *) nstm[b[Bs] + --k], cut);
+    }
+    return nlive;
+}
+
+// remove the stores to locals that no path reads before the function
+// returns or stores to them again
+void dse()
+{
+    int *b, k, m, more;
+
+    more = 1;
+    while (more) {
+        more = 0;
+        k = nblk;
+        while (k-- > 0) {
+            b = blk + k * Bsz;
+            if (!b[Breach]) {
+                continue;
+            }
+            m = 0;
+            if (b[Bto] >= 0) {
+                m = blk[b[Bto] * Bsz + Bin];
+            }
+            if (b[Bfall] >= 0) {
+                m = m | blk[b[Bfall] * Bsz + Bin];
+            }
+            b[Bout] = m;
+            m = alivein(b, 0);
+            if (m != b[Bin]) {
+                b[Bin] = m;
+                more = 1;
+            }
+        }
+    }
+    k = 0;
+    while (k < nblk) {
+        b = blk + k++ * Bsz;
+        if (b[Breach]) {
+            alivein(b, 1);
+        }
+    }
+}
+
+// drop what is left of the statements dse() took the stores out of, and
+// the value a block leaves in a if nothing reads it, but for its effects
+void prune()
+{
+    int *b, *h, i, k, n;
+
+    k = 0;
+    while (k < nblk) {
+        b = blk + k++ * Bsz;
+        n = 0;
+        i = 0;
+        while (i < b[Bn]) {
+            h = (int *) nstm[b[Bs] + i++];
+            if (effect(h)) {
+                nstm[b[Bs] + n++] = (int) discard(h);
+            }
+        }
+        b[Bn] = n;
+        if ((h = (int *) b[Blast]) && !needed(b)) {
+            b[Blast] = effect(h) ? (int) discard(h) : 0;
+        }
+    }
+}
+
+// -O: common subexpressions of a block, the last Cse seen
+enum { Cse = 64 };
+
+_Thread_local
+int *cavail[Cse],  // -O: expressions computed so far in the block
+    cmask[Cse],  // -O: slot bits of the locals each reads
+    cmem[Cse],   // -O: whether it reads memory
+    ctmp[Cse],   // -O: temporary holding its value, 0 for none yet
+    ncexp;       // -O: expressions seen
+
+// forget the expressions that read the locals in m, or memory if mem
+void forget(int m, int mem)
+{
+    int k;
+
+    k = 0;
+    while (k < Cse && k < ncexp) {
+        if ((cmask[k] & m) || (mem && cmem[k])) {
+            cavail[k] = 0;
+        }
+        ++k;
+    }
+}
+
+// walk n in the order it runs, and when it computes again what an earlier
+// tree in the block did, with no store in between to what that read, have
+// the first one leave it in a temporary and n read that. Trees of fewer
+// than 8 nodes, once peep() fuses them, cost less to compute again than
+// the store and the load.
+void cse(int *n)
+{
+    int *y, *l, i, k, m;
+
+    i = n[Nop];
+    l = (int *) n[Nl];
+    if (i == LI || i == LC) {
+        cse(l);
+    } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+        cse(l);
+        cse((int *) n[Nr]);
+    } else if (iscall(i)) {
+        k = 0;
+        while (k < n[Nr]) {
+            cse(((int **) l)[k++]);
+        }
+    }
+    if (i == SI || i == SC) {
+        m = l[Nop] == LEA ? slot(l[Nval]) : 0;
+        forget(m, !m);
+        return;
+    } else if (iscall(i)) {
+        forget(0, 1);
+        return;
+    }
+    nmem = 0;
+    if ((m = reads(n)) < 0 || cost(n) < 8 || nfree > nlim) {
+        return;
+    }
+    k = 0;
+    while (k < Cse && k < ncexp) {
+        if ((y = cavail[k]) && same(y, n)) {
+            if (!ctmp[k]) {
+                ctmp[k] = temp();
+                cavail[k] = ncopy(y);
+                y[Nop] = SI;
+                y[Nl] = (int) node(LEA, ctmp[k], 0, 0);
+                y[Nr] = (int) cavail[k];
+            }
+            n[Nop] = LI;
+            n[Nl] = (int) node(LEA, ctmp[k], 0, 0);
+            ++ncse;
+            return;
+        }
+        ++k;
+    }
+    k = ncexp++ % Cse;
+    cavail[k] = n;
+    cmask[k] = m;
+    cmem[k] = nmem & 1;
+    ctmp[k] = 0;
+}
+
+// lift the largest trees of n that compute the same on every iteration
+// of a loop, reading no memory and only locals not in the stores mask,
+// into stores to temporaries at the end of block pre, the one that jumps
+// into the loop
+void lift(int *n, int stores, int *pre)
+{
+    int *h, *l, i, k, m;
+
+    nmem = 0;
+    m = reads(n);
+    if (m >= 0 && !(m & stores) && !nmem && cost(n) >= 3 && nfree <= nlim) {
+        h = (int *) pre[Bh];
+        while (h && !same((int *) h[Nr], n)) {
+            h = (int *) h[Nn];
+        }
+        if (!h) {
+            h = node(SI, 0, (int) node(LEA, temp(), 0, 0), (int) ncopy(n));
+            h[Nn] = pre[Bh];
+            pre[Bh] = (int) h;
+            ++nhoist;
+        }
+        n[Nop] = LI;
+        n[Nl] = (int) node(LEA, ((int *) h[Nl])[Nval], 0, 0);
+        return;
+    }
+    i = n[Nop];
+    l = (int *) n[Nl];
+    if (i == LI || i == LC) {
+        lift(l, stores, pre);
+    } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+        lift(l, stores, pre);
+        lift((int *) n[Nr], stores, pre);
+    } else if (iscall(i)) {
+        k = 0;
+        while (k < n[Nr]) {
+            lift(((int **) l)[k++], stores, pre);
+        }
+    }
+}
+
+// slot bits of the locals n stores to
+int stores(int *n)
+{
+    int *l, i, k, m;
+
+    i = n[Nop];
+    l = (int *) n[Nl];
+    m = 0;
+    if (i == SI || i == SC) {
+        m = stores((int *) n[Nr]) | (l[Nop] == LEA ? sbit(l[Nval]) : stores(l));
+    } else if (i == LI || i == LC) {
+        m = stores(l);
+    } else if (i >= OR && i <= MOD) {
+        m = stores(l) | stores((int *) n[Nr]);
+    } else if (iscall(i)) {
+        k = 0;
+        while (k < n[Nr]) {
+            m = m | stores(((int **) l)[k++]);
+        }
+    }
+    return m;
+}
+
+// the trees of block b in the order they run, into t. Returns how many.
+int list(int *b, int *t)
+{
+    int *h, k, n;
+
+    n = 0;
+    k = 0;
+    while (k < b[Bn]) {
+        t[n++] = nstm[b[Bs] + k++];
+    }
+    if (b[Blast]) {
+        t[n++] = b[Blast];
+    }
+    h = (int *) b[Bh];
+    while (h) {
+        t[n++] = (int) h;
+        h = (int *) h[Nn];
+    }
+    k = 0;
+    while (k < b[Bnargs]) {
+        t[n++] = ((int *) b[Bargs])[k++];
+    }
+    return n;
+}
+
+// lift the invariant trees out of every while loop: the blocks from lo to
+// the BNZ at hi that branches back to lo, entered only by the JMP at the
+// end of the block before lo. Outer loops come first, so that what an
+// inner loop shares with them goes all the way out at once.
+void licm(int *t)
+{
+    int *h, *pre, *x, i, k, n, m, lo, hi;
+
+    lo = 1;
+    while (lo < nblk) {
+        hi = lo;
+        while (hi < nblk && (blk[hi * Bsz + Bt] != BNZ ||
+                             blk[hi * Bsz + Bto] != lo)) {
+            ++hi;
+        }
+        pre = blk + (lo - 1) * Bsz;
+        k = pre[Bto];
+        i = hi < nblk && blk[hi * Bsz + Breach] && pre[Breach] &&
+            pre[Bt] == JMP && k >= lo && k <= hi && !blk[k * Bsz + Bain];
+        k = 0;
+        m = 0;
+        while (i && k < nblk) {
+            x = blk + k * Bsz;
+            if (x[Breach] && k >= lo && k <= hi) {
+                n = list(x, t);
+                while (n > 0) {
+                    m = m | stores((int *) t[--n]);
+                }
+            } else if (x[Breach] && x != pre &&
+                       ((x[Bto] >= lo && x[Bto] <= hi) ||
+                        (x[Bfall] >= lo && x[Bfall] <= hi))) {
+                i = 0;
+            }
+            ++k;
+        }
+        k = lo;
+        while (i && k <= hi) {
+            x = blk + k++ * Bsz;
+            if (x[Breach]) {
+                n = list(x, t);
+                h = t;
+                while (h < t + n) {
+                    lift((int *) *h++, m, pre);
+                }
+            }
+        }
+        ++lo;
+    }
+}
+
+// emit the code of tree n
+void emit(int *n)
+{
+    int i, k;
+
+    i = n[Nop];
+    if (i == LEA || i == IMM || i == LEAG) {
+        *++ne = i;
+        *++ne = n[Nval];
+    } else if (i == LI || i == LC) {
+        emit((int *) n[Nl]);
+        *++ne = i;
+    } else if ((i >= OR && i <= MOD) || i == SI || i == SC) {
+        emit((int *) n[Nl]);
+        *++ne = PSH;
+        emit((int *) n[Nr]);
+        *++ne = i;
+    } else if (iscall(i)) {
+        k = 0;
+        while (k < n[Nr]) {
+            emit(((int **) n[Nl])[k++]);
+            *++ne = PSH;
+        }
+        *++ne = i;
+        if (i == JSR) {
+            *++ne = n[Nval];
+        }
+        if (n[Nr]) {
+            *++ne = ADJ;
+            *++ne = n[Nr];
+        }
+    }
+}
+
+// the code lower() emitted since the last call comes from line l, or
+// from the line of tree n if it has one
+int olines(int *out, int *n, int l)
+{
+    if (n && n[Nln]) {
+        l = n[Nln];
+    }
+    while (oz < ne) {
+        olin[++oz - out] = l;
+    }
+    return l;
+}
+
+// emit the function at f anew from its blocks into out, branches to
+// block numbers until the end, and return the number of words. The line
+// of every word goes to olin.
+int lower(int *f, int *out)
+{
+    int *b, *c, *h, i, k, l;
+
+    ne = out - 1;
+    oz = ne;
+    *++ne = ENT;
+    *++ne = nloc;
+    l = olines(out, 0, tline[f - text]);
+    k = 0;
+    while (k < nblk) {
+        b = blk + k++ * Bsz;
+        if (!b[Breach]) {
+            continue;
+        }
+        b[Bnew] = ne + 1 - out;
+        l = tline[(int *) b[Bpc] - text];
+        i = 0;
+        while (i < b[Bn]) {
+            emit((int *) nstm[b[Bs] + i]);
+            l = olines(out, (int *) nstm[b[Bs] + i++], l);
+        }
+        if (b[Blast]) {
+            emit((int *) b[Blast]);
+            l = olines(out, (int *) b[Blast], l);
+        }
+        h = (int *) b[Bh];
+        while (h) {
+            emit(h);
+            l = olines(out, h, l);
+            h = (int *) h[Nn];
+        }
+        if (b[Bt] == TSR) {
+            i = 0;
+            while (i < b[Bnargs]) {
+                emit(((int **) b[Bargs])[i++]);
+                *++ne = PSH;
+            }
+            if (b[Bnargs]) {
+                *++ne = TAIL;
+                *++ne = b[Bnargs];
+            }
+            *++ne = TSR;
+            *++ne = b[Bval];
+        } else if (b[Bt] == LEV) {
+            *++ne = LEV;
+        } else if (b[Bt]) {
+            // a jump to the next block left is no jump at all
+            i = k;
+            while (i < nblk && !blk[i * Bsz + Breach]) {
+                ++i;
+            }
+            if (b[Bt] != JMP || b[Bto] != i) {
+                *++ne = b[Bt];
+                *++ne = b[Bto];
+            }
+        }
+        olines(out, 0, l);
+    }
+    c = out + 2;
+    while (c <= ne) {
+        i = *c++;
+        if (i == JMP || i == BZ || i == BNZ) {
+            *c = (int) (f + blk[*c * Bsz + Bnew]);
+        }
+        if (i < LEV) {
+            ++c;
+        }
+    }
+    return ne + 1 - out;
+}
+
+// -O: optimize the function at f, which the parser just emitted up to e
+void optimize(int *f)
+{
+    int *bix, *b, *x, *t, n, k, m, ok;
+
+    n = e + 2 - f;
+    k = (8 * n + 64) * Nsz;
+    if (!(bix = malloc((3 * n + 3 * k) * sizeof(int))) ||
+        !(blk = malloc(n * Bsz * sizeof(int)))) {
+        printf("could not malloc(%ld) optimizer area\n", n * Bsz * sizeof(int));
+        fail();
+    }
+    memset(bix, 0, n * sizeof(int));
+    nstm = bix + n;
+    x = nstm + n;
+    nbuf = nfree = x + n;
+    nlim = nbuf + k - 8 * Nsz;
+    t = nbuf + k;
+    olin = t + k;
+    nnstm = nesc = ndead = ncse = nhoist = 0;
+    nloc = f[1];
+    tsync();
+
+    if ((ok = build(f, bix, x))) {
+        nat = 0;
+        // what the entry reaches
+        blk[Breach] = 1;
+        m = 1;
+        while (m) {
+            m = 0;
+            k = 0;
+            while (k < nblk) {
+                b = blk + k++ * Bsz;
+                if (b[Breach]) {
+                    if (b[Bto] >= 0 && !blk[b[Bto] * Bsz + Breach]) {
+                        m = blk[b[Bto] * Bsz + Breach] = 1;
+                    }
+                    if (b[Bfall] >= 0 && !blk[b[Bfall] * Bsz + Breach]) {
+                        m = blk[b[Bfall] * Bsz + Breach] = 1;
+                    }
+                }
+            }
+        }
+        // a block that leaves a as it found it passes on what it got
+        m = 1;
+        while (m) {
+            m = 0;
+            k = 0;
+            while (k < nblk) {
+                b = blk + k++ * Bsz;
+                if (b[Breach] && !b[Blast] && !b[Bain] && needed(b)) {
+                    m = b[Bain] = 1;
+                }
+            }
+        }
+        k = 0;
+        while (k < nblk) {
+            b = blk + k++ * Bsz;
+            if (b[Breach]) {
+                m = list(b, t);
+                while (m > 0) {
+                    escape((int *) t[--m], 0);
+                }
+            }
+        }
+
+        dse();
+        prune();
+        k = 0;
+        while (k < nblk) {
+            b = blk + k++ * Bsz;
+            if (b[Breach]) {
+                ncexp = 0;
+                m = list(b, t);
+                x = t;
+                while (x < t + m) {
+                    cse((int *) *x++);
+                }
+            }
+        }
+        licm(t);
+
+        n = lower(f, t);
+        ok = f + n + 1024 < tend;
+        if (ok) {
+            memcpy(f, t, n * sizeof(int));
+            e = f + n - 1;
+            le = e;
+            memcpy(tline + (f - text), olin, n * sizeof(int));
+            tlast = e;
+        }
+    }
+    if (src) {
+        m = 0;
+        k = 0;
+        while (ok && k < nblk) {
+            m = m + !blk[k++ * Bsz + Breach];
+        }
+        if (ok) {
+            printf("optimized: %ld unreachable blocks, %ld dead stores, "
+                   "%ld common subexpressions, %ld lifted out of loops\n",
+                   m, ndead, ncse, nhoist);
+            x = f - 1;
+            while (x < e) {
+                printf("%8.4s", &ops[*++x * 5]);
+                if (*x < LEV) {
+                    printf(" %ld\n", *++x);
+                } else {
+                    printf("\n");
+                }
+            }
+        } else {
+            printf("optimized: kept as emitted\n");
+        }
+    }
+    free(bix);
+    free(blk);
+    cst = call = 0;
+}
+
+// parse declarations
+void prog()
+{
+    int bt, ty, i, *t, *d;
+
+    line = 1;
+    next();
+    while (tk) {
+        room();
+        bt = INT;  // basetype
+        if (tk == Int) {
+            next();
+        } else if (tk == Char) {
+            next();
+            bt = CHAR;
+        } else if (tk == Enum) {
+            next();
+            if (tk != '{') {
+                // enum name
+                next();
+            }
+            if (tk == '{') {
+                next();
+                i = 0;
+                while (tk != '}') {
+                    if (tk != Id) {
+                        printf("%ld: bad enum identifier %ld\n", line, tk);
+                        fail();
+                    }
+                    d = id;
+                    next();
+                    if (tk == Assign) {
+                        next();
+                        t = e;
+                        expr(Cond);
+                        if (e != t + 2 || cst != t + 1) {
+                            printf("%ld: bad enum initializer\n", line);
+                            fail();
+                        }
+                        i = *e;
+                        e = t;
+                    }
+                    d[Class] = Num;
+                    d[Type] = INT;
+                    d[Val] = i++;
+                    if (tk == ',') {
+                        next();
+                    }
+                }
+                next();
             }
         }
 
@@ -915,12 +2776,12 @@ int main(int argc, char *argv[])
                 ty = ty + PTR;
             }
             if (tk != Id) {
-                printf("%d: bad global declaration\n", line);
-                return -1;
+                printf("%ld: bad global declaration\n", line);
+                fail();
             }
             if (id[Class]) {
-                printf("%d: duplicate global definition\n", line);
-                return -1;
+                printf("%ld: duplicate global definition\n", line);
+                fail();
             }
             next();
             id[Type] = ty;
@@ -942,13 +2803,14 @@ int main(int argc, char *argv[])
                         ty = ty + PTR;
                     }
                     if (tk != Id) {
-                        printf("%d: bad parameter declaration\n", line);
-                        return -1;
+                        printf("%ld: bad parameter declaration\n", line);
+                        fail();
                     }
                     if (id[Class] == Loc) {
-                        printf("%d: duplicate parameter definition\n", line);
-                        return -1;
+                        printf("%ld: duplicate parameter definition\n", line);
+                        fail();
                     }
+                    *++sc = (int) id;
                     id[HClass] = id[Class];
                     id[Class] = Loc;
                     id[HType] = id[Type];
@@ -962,12 +2824,13 @@ int main(int argc, char *argv[])
                 }
                 next();
                 if (tk != '{') {
-                    printf("%d: bad function definition\n", line);
-                    return -1;
+                    printf("%ld: bad function definition\n", line);
+                    fail();
                 }
                 loc = ++i;
+                lea = 0;
                 next();
-                while (tk == Inc || tk == Char) {
+                while (tk == Int || tk == Char) {
                     bt = (tk == Int) ? INT : CHAR;
                     next();
                     while (tk != ';') {
@@ -977,13 +2840,14 @@ int main(int argc, char *argv[])
                             ty = ty + PTR;
                         }
                         if (tk != Id) {
-                            printf("%d: bad local declaration\n", line);
-                            return -1;
+                            printf("%ld: bad local declaration\n", line);
+                            fail();
                         }
                         if (id[Class] == Loc) {
-                            printf("%d: duplicate local definition\n", line);
-                            return -1;
+                            printf("%ld: duplicate local definition\n", line);
+                            fail();
                         }
+                        *++sc = (int) id;
                         id[HClass] = id[Class];
                         id[Class] = Loc;
                         id[HType] = id[Type];
@@ -996,24 +2860,25 @@ int main(int argc, char *argv[])
                     }
                     next();
                 }
+                d = e + 1;
                 *++e = ENT;
                 *++e = i - loc;
                 while (tk != '}') {
                     stmt();
                 }
                 *++e = LEV;
-                id = sym;  // unwind symbol table local
-                while (id[Tk]) {
-                    if (id[Class] == Loc) {
-                        id[Class] = id[HClass];
-                        id[Type] = id[HType];
-                        id[Val] = id[HVal];
-                    }
-                    id = id + Idsz;
+                if (opt >= 1) {
+                    optimize(d);
+                }
+                while (sc > scope) {  // unwind symbol table locals
+                    id = (int *) *sc--;
+                    id[Class] = id[HClass];
+                    id[Type] = id[HType];
+                    id[Val] = id[HVal];
                 }
             } else {
                 id[Class] = Glo;
-                id[Val] = (int) data;
+                id[Val] = data - dbase;
                 data = data + sizeof(int);
             }
             if (tk == ',') {
@@ -1022,149 +2887,3738 @@ int main(int argc, char *argv[])
         }
         next();
     }
+}
+
+// reserve an arena of sz bytes with a PROT_NONE guard page on each side.
+// Pages are backed and zeroed by the kernel on first touch, so an arena
+// grows on demand without ever moving and costs nothing until it is used.
+char *arena(int sz, char *what)
+{
+    char *a;
+
+    sz = (sz + 4095) & -4096;
+    a = mmap(0, sz + 2 * 4096, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (a == MAP_FAILED ||
+        mprotect(a + 4096, sz, PROT_READ | PROT_WRITE) < 0) {
+        printf("could not mmap(%ld) %s area\n", sz, what);
+        fail();
+    }
+    return a + 4096;
+}
+
+// give an arena of sz bytes back, guard pages and all
+void release(char *a, int sz)
+{
+    munmap(a - 4096, ((sz + 4095) & -4096) + 2 * 4096);
+}
 
-    if (!(pc = (int *) idmain[Val])) {
-        printf("main() mot defined\n");
+// bytes of an arena the program actually touched
+int touched(char *a, int sz)
+{
+    unsigned char *v;
+    int i, n;
+
+    sz = (sz + 4095) & -4096;
+    if (!(v = malloc(sz / 4096)) || mincore(a, sz, v) < 0) {
         return -1;
     }
+    n = i = 0;
+    while (i < sz / 4096) {
+        n = n + (v[i++] & 1);
+    }
+    free(v);
+    return n * 4096;
+}
 
-    if (src) {
-        return 0;
+// -v: monotonic wall clock in seconds
+double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// -v: compile and run throughput, then the peak usage of every arena.
+// Each "stat" line is a name, a count and an optional rate, in that order,
+// so that bench/run.sh can pick them apart.
+void report(char *stk)
+{
+    int *c, n;
+
+    n = 0;
+    c = text + 1;
+    while (c <= e) {
+        c = c + (*c < LEV ? 2 : 1);
+        ++n;
     }
+    printf("stat lines  %10ld %14.0f lines/s\n", nline,
+           tparse > 0 ? nline / tparse : 0.0);
+    printf("stat insts  %10ld\n", n);
+    if (jitted && !debug && !profile) {
+        printf("stat cycles %10s %14s cycles/s\n", "-", "-");
+    } else {
+        printf("stat cycles %10ld %14.0f cycles/s\n", ncycle,
+               trun > 0 ? ncycle / trun : 0.0);
+    }
+    printf("stat wall   %10.4f s (parse %.4f s, run %.4f s)\n",
+           now() - tstart, tparse, trun);
 
-    // setup stack
-    bp = sp = (int *) ((int) sp + poolsz);
-    *--sp = EXIT;  // call exit if main returns
-    *--sp = PSH;
-    t = sp;
-    *--sp = argc;
-    *--sp = (int) argv;
-    *--sp = (int) t;
+    printf("arena sym   %10ld / %ld bytes\n", nsym * Idsz * sizeof(int),
+           symsz * Idsz * sizeof(int));
+    printf("arena text  %10ld / %ld bytes\n", (e - text + 1) * sizeof(int),
+           (tend - text) * sizeof(int));
+    printf("arena data  %10ld / %ld bytes\n", data - dbase, dend - dbase);
+    printf("arena stack %10ld / %ld bytes\n", touched(stk, stksz), stksz);
 
-    // run...
-    cycle = 0;
-    while (1) {
-        i = *pc++;
-        ++cycle;
-        if (debug) {
-            printf("%d> %.4s", cycle, &"LEA ,IMM ,JMP ,JSR ,BZ  ,BNZ ,ENT ,ADJ ,LEV ,LI  ,LC  ,SI  ,SC  ,PSH ,"
-                                       "OR  ,XOR ,AND ,EQ  ,NE  ,LT  ,GT  ,LE  ,GE  ,SHL ,SHR ,ADD ,SUB ,MUL ,DIV ,MOD ,"
-                                       "OPEN,READ,CLOS,PRTF,MALC,FREE,MSET,MCMP,EXIT,"[i * 5]);
+    printf("heap live   %10ld bytes at exit, peak %ld, mapped peak %ld\n",
+           hlive, hpeak, hmax);
+    n = 0;
+    while (n <= Hclass) {
+        if (hcount[n]) {
+            if (n < Hclass) {
+                printf("heap %-6ld %10ld allocations\n", (int) Hmin << n,
+                       hcount[n]);
+            } else {
+                printf("heap large  %10ld allocations\n", hcount[n]);
+            }
         }
-        if (i <= ADJ) {
-            printf(" %d\n", *pc);
+        ++n;
+    }
+}
+
+// log2 of a power of two, -1 otherwise
+int lg(int k)
+{
+    int i;
+
+    i = 0;
+    while (k > 1 && !(k & 1)) {
+        k = k >> 1;
+        ++i;
+    }
+    return k == 1 ? i : -1;
+}
+
+// whether the accumulator is read before it is written from c on
+int alive(int *c)
+{
+    int n, i;
+
+    n = 0;
+    while (n++ < 8) {
+        i = *c;
+        if (i == JMP) {
+            c = (int *) c[1];
+        } else if (i == ADJ || i == TAIL) {
+            c = c + 2;
         } else {
-            printf("\n");
+            return i != IMM && i != LEA && i != LEAG && i != LLI && i != LLC &&
+                   i != JSR && i != TSR && i != ENT && (i < OPEN || i > EXIT);
         }
+    }
+    return 1;
+}
 
+// peephole pass over the text segment: fuse the sequences expr() emits
+// for local reads, immediates and pointer arithmetic into superinstructions
+// and compact the segment in place. A sequence is only fused when no branch
+// lands inside it. Returns the number of instructions removed.
+int peep()
+{
+    int *r, *w, *t, *tgt, *map, n, i, k, s, l;
+
+    n = e - text + 2;
+    if (!(tgt = malloc(n * sizeof(int))) || !(map = malloc(n * sizeof(int)))) {
+        printf("could not malloc(%ld) peephole area\n", n * sizeof(int));
+        fail();
+    }
+    memset(tgt, 0, n * sizeof(int));
+
+    // thread jumps: a branch to a JMP goes where the JMP goes, and a BZ or
+    // BNZ to another one tests the same a, so it goes where that one would.
+    // && and || chains then branch straight to the statement they decide.
+    r = text + 1;
+    while (r <= e) {
+        i = *r++;
+        if (i == JMP || i == BZ || i == BNZ) {
+            t = (int *) *r;
+            n = 0;
+            while (n++ < 8) {
+                if (*t == JMP) {
+                    t = (int *) t[1];
+                } else if (i != JMP && (*t == BZ || *t == BNZ)) {
+                    t = *t == i ? (int *) t[1] : t + 2;
+                } else {
+                    break;
+                }
+            }
+            *r = (int) t;
+        }
+        if (i < LEV) {
+            ++r;
+        }
+    }
+
+    // mark branch targets and function entries
+    r = text + 1;
+    while (r <= e) {
+        i = *r++;
+        if (i == JMP || i == JSR || i == TSR || (i >= BZ && i <= BGE)) {
+            tgt[(int *) *r - text] = 1;
+        }
+        if (i < LEV) {
+            ++r;
+        }
+    }
+    id = sym;
+    while (id < sym + nsym * Idsz) {
+        if (id[Class] == Fun) {
+            tgt[(int *) id[Val] - text] = 1;
+        }
+        id = id + Idsz;
+    }
+
+    // mark the comparisons that can branch themselves: those followed by a
+    // BZ or BNZ no branch lands on, when nothing after it either way reads
+    // the 0 or 1 the comparison would have left in a. Done before the
+    // segment is compacted over the code alive() looks at.
+    r = text + 1;
+    while (r <= e) {
+        i = *r;
+        if (i >= EQ && i <= GE && r + 2 <= e && (r[1] == BZ || r[1] == BNZ) &&
+            !tgt[r + 1 - text] && !alive((int *) r[2]) && !alive(r + 3)) {
+            tgt[r - text] = tgt[r - text] | 2;
+        }
+        r = r + (i < LEV ? 2 : 1);
+    }
+
+    r = w = text + 1;
+    k = 0;
+    while (r <= e) {
+        map[r - text] = w - text;
+        i = *r;
+        t = w;
+        l = tline[r - text];
+        if (tgt[r - text] & 2) {
+            // LT; BNZ -> BLT and LT; BZ -> BGE
+            s = r[1] == BNZ ? i - EQ : "\1\0\5\4\3\2"[i - EQ];
+            *w++ = BEQ + s;
+            *w++ = r[2];
+            r = r + 3;
+            ++k;
+        } else if (i == LEA && r + 2 <= e && (r[2] == LI || r[2] == LC) &&
+                   !tgt[r + 2 - text]) {
+            // LEA n; LI -> LLI n
+            *w++ = r[2] == LI ? LLI : LLC;
+            *w++ = r[1];
+            r = r + 3;
+            ++k;
+        } else if (i == PSH && r + 3 <= e && r[1] == IMM && !tgt[r + 1 - text] &&
+                   !tgt[r + 3 - text] && r[2] >= -0x7fffffff &&
+                   r[2] <= 0x7fffffff &&
+                   (r[3] == MUL || r[3] == ADD || r[3] == SUB)) {
+            s = lg(r[2]);
+            if (r[3] == MUL && r + 4 <= e && r[4] == ADD &&
+                !tgt[r + 4 - text] && s >= 0) {
+                // PSH; IMM 2^s; MUL; ADD -> ADDP s
+                *w++ = ADDP;
+                *w++ = s;
+                r = r + 5;
+                k = k + 3;
+            } else {
+                // PSH; IMM k; op -> ADDI/MULI/SHLI k
+                if (r[3] == MUL) {
+                    *w++ = s >= 0 ? SHLI : MULI;
+                    *w++ = s >= 0 ? s : r[2];
+                } else {
+                    *w++ = ADDI;
+                    *w++ = r[3] == ADD ? r[2] : -r[2];
+                }
+                r = r + 4;
+                k = k + 2;
+            }
+        } else {
+            *w++ = *r++;
+            if (i < LEV) {
+                *w++ = *r++;
+            }
+        }
+        // a fused instruction is on the line of the first it replaces
+        while (t < w) {
+            tline[t++ - text] = l;
+        }
+    }
+    map[r - text] = w - text;
+    e = tlast = w - 1;
+
+    // retarget branches and function entries
+    r = text + 1;
+    while (r <= e) {
+        i = *r++;
+        if (i == JMP || i == JSR || i == TSR || (i >= BZ && i <= BGE)) {
+            *r = (int) (text + map[(int *) *r - text]);
+        }
+        if (i < LEV) {
+            ++r;
+        }
+    }
+    id = sym;
+    while (id < sym + nsym * Idsz) {
+        if (id[Class] == Fun) {
+            id[Val] = (int) (text + map[(int *) id[Val] - text]);
+        }
+        id = id + Idsz;
+    }
+
+    free(tgt);
+    free(map);
+    return k;
+}
+
+// pack tline into ltab once the code is final
+void lpack()
+{
+    int *t;
+
+    ltab = (int *) arena((e - text + 1) * 2 * sizeof(int), "line");
+    nltab = 0;
+    t = text + 1;
+    while (t <= e) {
+        if (!nltab || tline[t - text] != ltab[nltab * 2 - 1]) {
+            ltab[nltab * 2] = t - text;
+            ltab[nltab * 2 + 1] = tline[t - text];
+            ++nltab;
+        }
+        ++t;
+    }
+}
+
+// the source line of text index k, 0 if it is not known
+int lineat(int k)
+{
+    int lo, hi, m;
+
+    lo = 0;
+    hi = nltab;
+    while (lo < hi) {
+        m = (lo + hi) / 2;
+        if (ltab[m * 2] <= k) {
+            lo = m + 1;
+        } else {
+            hi = m;
+        }
+    }
+    return lo ? ltab[lo * 2 - 1] : 0;
+}
+
+// clang-format off
+// compiled image header words, followed by the text segment (branch
+// operands stored as text offsets), the data segment, the line table, the
+// entry of every function as a text offset and the names of the functions
+// in the same order, each followed by a blank, then a '\0' and padding to
+// a whole word
+enum { Magic, Version, Word, Ntext, Ndata, Nline, Nfun, Nname, Entry, Hdrsz };
+// clang-format on
+
+// FNV-1a hash of the source and everything that changes the emitted code
+unsigned long long hash(char *s, int n)
+{
+    unsigned long long h;
+
+    h = 14695981039346656037ULL ^ (opt * 31 + sizeof(int)) ^ 6;
+    while (n-- > 0) {
+        h = (h ^ (*s++ & 255)) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// write the text and data segments and the entry point to file, via a
+// temporary so a concurrent reader never sees a partial image
+int save(char *file, int *pc)
+{
+    int fd, h[Hdrsz], *t, *c, *f, i, n, m;
+    char tmp[4096], *s;
+
+    sprintf(tmp, "%.4000s.%ld", file, (int) getpid());
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        printf("could not open(%s)\n", tmp);
+        return -1;
+    }
+    n = m = 0;
+    id = sym;
+    while (id < sym + nsym * Idsz) {
+        if (id[Class] == Fun) {
+            ++n;
+            m = m + scan((char *) id[Name], Sid, 0) - (char *) id[Name] + 1;
+        }
+        id = id + Idsz;
+    }
+    m = (m + sizeof(int)) & -sizeof(int);
+    if (!(c = malloc((e - text + 1 + n) * sizeof(int) + m))) {
+        printf("could not malloc(%ld) image area\n", (e - text + 1) * sizeof(int));
+        return -1;
+    }
+    f = c + (e - text + 1);
+    s = (char *) (f + n);
+    memset(s, 0, m);
+    id = sym;
+    while (id < sym + nsym * Idsz) {
+        if (id[Class] == Fun) {
+            *f++ = (int *) id[Val] - text;
+            i = scan((char *) id[Name], Sid, 0) - (char *) id[Name];
+            memcpy(s, (char *) id[Name], i);
+            s[i] = ' ';
+            s = s + i + 1;
+        }
+        id = id + Idsz;
+    }
+    t = text + 1;
+    while (t <= e) {
+        i = c[t - text] = *t;
+        ++t;
+        if (i == JMP || i == JSR || i == TSR || (i >= BZ && i <= BGE)) {
+            c[t - text] = (int *) *t - text;
+            ++t;
+        } else if (i < LEV) {
+            c[t - text] = *t;
+            ++t;
+        }
+    }
+    h[Magic] = 'B' | 'F' << 8 | 'C' << 16 | 'I' << 24;
+    h[Version] = 6;
+    h[Word] = sizeof(int);
+    h[Ntext] = e - text;
+    h[Ndata] = (data - dbase + sizeof(int) - 1) & -sizeof(int);
+    h[Nline] = nltab;
+    h[Nfun] = n;
+    h[Nname] = m;
+    h[Entry] = pc - text;
+    if (write(fd, h, sizeof(h)) != sizeof(h) ||
+        write(fd, c + 1, h[Ntext] * sizeof(int)) != h[Ntext] * sizeof(int) ||
+        write(fd, dbase, h[Ndata]) != h[Ndata] ||
+        write(fd, ltab, nltab * 2 * sizeof(int)) != nltab * 2 * sizeof(int) ||
+        write(fd, c + h[Ntext] + 1, n * sizeof(int) + m) !=
+            n * sizeof(int) + m) {
+        printf("could not write(%s)\n", tmp);
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    free(c);
+    if (rename(tmp, file) < 0) {
+        printf("could not rename(%s)\n", tmp);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// map a compiled image privately and relocate its branch operands against
+// the address it landed at, returns the entry point or 0 if file does not
+// exist
+int *load(char *file)
+{
+    int fd, n, *h, *t, *c, *z, i;
+    char *s;
+
+    if ((fd = open(file, 0)) < 0) {
+        return 0;
+    }
+    n = lseek(fd, 0, SEEK_END);
+    h = mmap(0, n, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        printf("could not mmap(%s)\n", file);
+        return 0;
+    }
+    if (n < sizeof(int) * Hdrsz || h[Magic] != ('B' | 'F' << 8 | 'C' << 16 | 'I' << 24) ||
+        h[Version] != 6 || h[Word] != sizeof(int) ||
+        (Hdrsz + h[Ntext] + h[Nline] * 2 + h[Nfun]) * sizeof(int) +
+                h[Ndata] + h[Nname] != n ||
+        h[Entry] < 1 || h[Entry] > h[Ntext] || h[Nname] < 1 ||
+        ((char *) h)[n - 1]) {
+        printf("%s: not a compatible bfcc image\n", file);
+        munmap(h, n);
+        return 0;
+    }
+    // the segments only become the image's once all of it checks out
+    c = h + Hdrsz - 1;
+    z = c + h[Ntext];
+    t = c + 1;
+    while (t <= z) {
+        i = *t++;
+        if (i < 0 || i > EXIT || (i < LEV && t > z)) {
+            printf("%s: bad instruction %ld\n", file, i);
+            munmap(h, n);
+            return 0;
+        }
+        if (i == JMP || i == JSR || i == TSR || (i >= BZ && i <= BGE)) {
+            if (*t < 1 || *t > h[Ntext]) {
+                printf("%s: bad branch target %ld\n", file, *t);
+                munmap(h, n);
+                return 0;
+            }
+            *t = (int) (c + *t);
+        }
+        if (i < LEV) {
+            ++t;
+        }
+    }
+
+    // the functions go into the symbol table, for -p, -F and -A to name,
+    // and come out again if the table turns out to be bad. The caller's
+    // source position is kept for it to parse from instead.
+    s = p;
+    t = (int *) ((char *) (z + 1) + h[Ndata]) + h[Nline] * 2;
+    p = (char *) (t + h[Nfun]);
+    i = 0;
+    while (i < h[Nfun]) {
+        next();
+        if (tk != Id || id[Class] || t[i] < 1 || t[i] > h[Ntext]) {
+            printf("%s: bad function table\n", file);
+            p = (char *) (t + h[Nfun]);
+            while (i-- > 0) {
+                next();
+                id[Class] = id[Type] = id[Val] = 0;
+            }
+            p = s;
+            munmap(h, n);
+            return 0;
+        }
+        id[Class] = Fun;
+        id[Type] = INT;
+        id[Val] = (int) (c + t[i++]);
+    }
+    text = c;
+    e = tlast = z;
+    dbase = (char *) (e + 1);
+    data = dbase + h[Ndata];
+    ltab = (int *) data;
+    nltab = h[Nline];
+    p = s;
+    return text + h[Entry];
+}
+
+// -A: the name of function entry k, a text index, in the assembly: bfcc.
+// and the name in the symbol table, or the index for an image without one
+void fname(FILE *f, int k)
+{
+    char *s;
+
+    id = sym;
+    while (id < sym + nsym * Idsz) {
+        if (id[Class] == Fun && (int *) id[Val] == text + k) {
+            s = (char *) id[Name];
+            fprintf(f, "bfcc.%.*s", (signed) (scan(s, Sid, 0) - s), s);
+            return;
+        }
+        id = id + Idsz;
+    }
+    fprintf(f, "bfcc.f%ld", k);
+}
+
+// -A: end the function at entry k, if any, for perf and gdb
+void fsize(FILE *f, int k)
+{
+    if (k) {
+        fprintf(f, "\t.size ");
+        fname(f, k);
+        fprintf(f, ", .-");
+        fname(f, k);
+        fprintf(f, "\n");
+    }
+}
+
+// -A: load argument register n (rdi, rsi, rdx, rcx, r8, r9) from [rbx + off]
+void farg(FILE *f, int n, int off)
+{
+    fprintf(f, "\tmov %s, [rbx + %ld]\n",
+            &"rdi\0rsi\0rdx\0rcx\0r8\0\0r9"[n * 4], off);
+}
+
+// -A: call into libc like jcall() does, on a 16 byte aligned stack with
+// rbx keeping the VM sp
+void fcall(FILE *f, char *fn)
+{
+    fprintf(f, "\txor eax, eax\n\tcall %s@PLT\n\tmov rsp, rbx\n", fn);
+}
+
+// -A: write the program as x86-64 assembly for the GNU assembler, built
+// from the same templates as jit(): a in rax, the VM stack the native one
+// with frames linked through rbp, JSR and LEV call and ret. The system
+// functions become calls into libc and main() the C main(), so that
+//
+//     cc prog.s -o prog
+//
+// links a standalone executable. There is no heap cap and no stack
+// overflow report, it has libc's malloc() and the native stack.
+int native(char *file, int *pc)
+{
+    FILE *f;
+    int *t, *c, *tgt, n, i, k, fn;
+    char *s;
+
+#if !defined(__x86_64__)
+    printf("native code needs an x86-64 host\n");
+    return -1;
+#endif
+    if (sizeof(int) != 8) {
+        printf("native code needs a 64-bit word\n");
+        return -1;
+    }
+    if (!(f = fopen(file, "w"))) {
+        printf("could not open(%s)\n", file);
+        return -1;
+    }
+    n = e - text + 2;
+    if (!(tgt = malloc(n * sizeof(int)))) {
+        printf("could not malloc(%ld) native area\n", n * sizeof(int));
+        return -1;
+    }
+    // 1 for branch targets, 2 for function entries
+    memset(tgt, 0, n * sizeof(int));
+    tgt[pc - text] = 2;
+    t = text + 1;
+    while (t <= e) {
+        i = *t++;
+        if (i == JMP || i == JSR || i == TSR || (i >= BZ && i <= BGE)) {
+            k = (int *) *t - text;
+            tgt[k] = tgt[k] | (i == JSR || i == TSR ? 2 : 1);
+        }
+        if (i < LEV) {
+            ++t;
+        }
+    }
+
+    fprintf(f, "# compiled by bfcc, link with: cc -o prog %s\n", file);
+    fprintf(f, "\t.intel_syntax noprefix\n\t.text\n");
+    // main(argc, argv): save the host registers, call main() of the
+    // program with its arguments pushed and return what it returns
+    fprintf(f, "\t.globl main\n\t.type main, @function\nmain:\n"
+               "\tpush rbx\n\tpush rbp\n\tpush r12\n\tpush r15\n"
+               "\tmov r15, rsp\n\tpush rdi\n\tpush rsi\n\tcall .L%ld\n"
+               "\tmov rsp, r15\n\tpop r15\n\tpop r12\n\tpop rbp\n"
+               "\tpop rbx\n\tret\n"
+               "\t.size main, .-main\n",
+            pc - text);
+    // write(): standard output goes through stdio like printf()
+    fprintf(f, "bfcc.write:\n\tcmp rdi, 1\n\tjne write@PLT\n"
+               "\tsub rsp, 8\n\tmov rdi, rsi\n\tmov esi, 1\n"
+               "\tmov rcx, [rip + stdout@GOTPCREL]\n\tmov rcx, [rcx]\n"
+               "\tcall fwrite@PLT\n\tadd rsp, 8\n\tret\n");
+    // printf(): the format widened like widen() does, into a copy on the
+    // stack twice its length
+    fprintf(f, "bfcc.printf:\n\tpush rbp\n\tmov rbp, rsp\n\tpush rsi\n"
+               "\tpush rdx\n\tpush rcx\n\tpush r8\n\tpush r9\n"
+               "\txor eax, eax\n"
+               ".Lpf.len:\n\tcmp byte ptr [rdi + rax], 0\n\tje .Lpf.buf\n"
+               "\tinc rax\n\tjmp .Lpf.len\n"
+               ".Lpf.buf:\n\tlea rax, [rax + rax + 16]\n\tand rax, -16\n"
+               "\tsub rsp, rax\n\tand rsp, -16\n\tmov r11, rsp\n"
+               ".Lpf.copy:\n\tmov al, [rdi]\n\tinc rdi\n\tmov [r11], al\n"
+               "\tinc r11\n\ttest al, al\n\tjz .Lpf.call\n"
+               "\tcmp al, %d\n\tjne .Lpf.copy\n\tmov al, [rdi]\n"
+               "\tcmp al, %d\n\tjne .Lpf.spec\n\tinc rdi\n\tmov [r11], al\n"
+               "\tinc r11\n\tjmp .Lpf.copy\n"
+               ".Lpf.spec:\n\tmov al, [rdi]\n",
+            '%', '%');
+    s = "-+ #.*0123456789";
+    while (*s) {
+        fprintf(f, "\tcmp al, %d\n\tje .Lpf.keep\n", *s++);
+    }
+    s = "diouxX";
+    while (*s) {
+        fprintf(f, "\tcmp al, %d\n\tje .Lpf.long\n", *s++);
+    }
+    fprintf(f, "\tjmp .Lpf.copy\n"
+               ".Lpf.keep:\n\tinc rdi\n\tmov [r11], al\n\tinc r11\n"
+               "\tjmp .Lpf.spec\n"
+               ".Lpf.long:\n\tmov byte ptr [r11], %d\n\tinc r11\n"
+               "\tjmp .Lpf.copy\n"
+               ".Lpf.call:\n\tmov rdi, rsp\n\tmov rsi, [rbp - 8]\n"
+               "\tmov rdx, [rbp - 16]\n\tmov rcx, [rbp - 24]\n"
+               "\tmov r8, [rbp - 32]\n\tmov r9, [rbp - 40]\n"
+               "\txor eax, eax\n\tcall printf@PLT\n\tleave\n\tret\n",
+            'l');
+
+    fn = 0;
+    t = text + 1;
+    while (t <= e) {
+        c = t;
+        if (tgt[c - text] & 2) {
+            fsize(f, fn);
+            fn = c - text;
+            fprintf(f, "\t.type ");
+            fname(f, fn);
+            fprintf(f, ", @function\n");
+            fname(f, fn);
+            fprintf(f, ":\n");
+        }
+        if (tgt[c - text]) {
+            fprintf(f, ".L%ld:\n", c - text);
+        }
+        i = *t++;
         if (i == LEA) {
-            // load local address
-            a = (int) (bp + *pc++);
+            fprintf(f, "\tlea rax, [rbp + %ld]\n", *t++ * 8);
         } else if (i == IMM) {
-            // load global address or immediate
-            a = *pc++;
-        } else if (i == JMP) {
-            // jump
-            pc = (int *) *pc;
-        } else if (i == JSR) {
-            // jump to subroutine
-            *--sp = (int) (pc + 1);
-            pc = (int *) *pc;
-        } else if (i == BZ) {
-            // branch if zero
-            pc = a ? pc + 1 : (int *) *pc;
-        } else if (i == BNZ) {
-            // branch if not zero
-            pc = a ? (int *) *pc : pc + 1;
+            fprintf(f, "\tmov rax, %ld\n", *t++);
+        } else if (i == JMP || i == JSR) {
+            fprintf(f, "\t%s .L%ld\n", i == JMP ? "jmp" : "call",
+                    (int *) *t++ - text);
+        } else if (i == TSR) {
+            fprintf(f, "\tlea rsp, [rbp + 8]\n\tmov rbp, [rbp]\n"
+                       "\tjmp .L%ld\n", (int *) *t++ - text);
+        } else if (i == BZ || i == BNZ) {
+            fprintf(f, "\ttest rax, rax\n\t%s .L%ld\n", i == BZ ? "jz" : "jnz",
+                    (int *) *t++ - text);
+        } else if (i >= BEQ && i <= BGE) {
+            fprintf(f, "\tpop rcx\n\tcmp rcx, rax\n\tj%s .L%ld\n",
+                    &"e\0\0ne\0l\0\0g\0\0le\0ge"[(i - BEQ) * 3],
+                    (int *) *t++ - text);
         } else if (i == ENT) {
-            // enter subroutine
-            *--sp = (int) bp;
-            bp = sp;
-            sp = sp - *pc++;
+            fprintf(f, "\tpush rbp\n\tmov rbp, rsp\n\tsub rsp, %ld\n",
+                    *t++ * 8);
         } else if (i == ADJ) {
-            // stack adjust
-            sp = sp + *pc++;
+            fprintf(f, "\tadd rsp, %ld\n", *t++ * 8);
+        } else if (i == TAIL) {
+            n = *t++;
+            while (n--) {
+                fprintf(f, "\tmov rcx, [rsp + %ld]\n", n * 8);
+                fprintf(f, "\tmov [rbp + %ld], rcx\n", 16 + n * 8);
+            }
+        } else if (i == ADDI) {
+            fprintf(f, "\tadd rax, %ld\n", *t++);
+        } else if (i == MULI) {
+            fprintf(f, "\timul rax, rax, %ld\n", *t++);
+        } else if (i == SHLI) {
+            fprintf(f, "\tshl rax, %ld\n", *t++);
+        } else if (i == LLI) {
+            fprintf(f, "\tmov rax, [rbp + %ld]\n", *t++ * 8);
+        } else if (i == LLC) {
+            fprintf(f, "\tmovsx rax, byte ptr [rbp + %ld]\n", *t++ * 8);
+        } else if (i == ADDP) {
+            fprintf(f, "\tpop rcx\n\tshl rax, %ld\n\tadd rax, rcx\n", *t++);
+        } else if (i == LEAG) {
+            fprintf(f, "\tlea rax, [rip + bfcc.data + %ld]\n", *t++);
         } else if (i == LEV) {
-            // leave subroutine
-            sp = bp;
-            bp = (int *) *sp++;
-            pc = (int *) *sp++;
+            fprintf(f, "\tmov rsp, rbp\n\tpop rbp\n\tret\n");
         } else if (i == LI) {
-            // load int
-            a = *(int *) a;
+            fprintf(f, "\tmov rax, [rax]\n");
         } else if (i == LC) {
-            // load char
-            a = *(char *) a;
+            fprintf(f, "\tmovsx rax, byte ptr [rax]\n");
         } else if (i == SI) {
-            // store int
-            *(int *) *sp++ = a;
+            fprintf(f, "\tpop rcx\n\tmov [rcx], rax\n");
         } else if (i == SC) {
-            // store char
-            a = *(char *) *sp++ = a;
+            fprintf(f, "\tpop rcx\n\tmov [rcx], al\n\tmovsx rax, al\n");
         } else if (i == PSH) {
-            // push
-            *--sp = a;
-        }
-
-        else if (i == OR) {
-            a = *sp++ | a;
-        } else if (i == XOR) {
-            a = *sp++ ^ a;
-        } else if (i == AND) {
-            a = *sp++ & a;
-        } else if (i == EQ) {
-            a = *sp++ == a;
-        } else if (i == NE) {
-            a = *sp++ != a;
-        } else if (i == LT) {
-            a = *sp++ < a;
-        } else if (i == GT) {
-            a = *sp++ > a;
-        } else if (i == LE) {
-            a = *sp++ <= a;
-        } else if (i == GE) {
-            a = *sp++ >= a;
-        } else if (i == SHL) {
-            a = *sp++ << a;
-        } else if (i == SHR) {
-            a = *sp++ >> a;
-        } else if (i == ADD) {
-            a = *sp++ + a;
+            fprintf(f, "\tpush rax\n");
         } else if (i == SUB) {
-            a = *sp++ - a;
-        } else if (i == MUL) {
-            a = *sp++ * a;
-        } else if (i == DIV) {
-            a = *sp++ / a;
-        } else if (i == MOD) {
-            a = *sp++ % a;
-        }
-        // system function call
-        else if (i == OPEN) {
-            a = open((char *) sp[1], *sp);
-        } else if (i == READ) {
-            a = read(sp[2], (char *) sp[1], *sp);
-        } else if (i == CLOS) {
-            a = close(*sp);
-        } else if (i == PRTF) {
-            t = sp + pc[1];
-            a = printf((char *) t[-1], t[-2], t[-3], t[-4], t[-5], t[-6]);
-        } else if (i == MALC) {
-            a = (int) malloc(*sp);
-        } else if (i == FREE) {
-            free((void *) *sp);
-        } else if (i == MSET) {
-            a = (int) memset((char *) sp[2], sp[1], *sp);
-        } else if (i == MCMP) {
-            a = memcmp((char *) sp[2], (char *) sp[1], *sp);
+            fprintf(f, "\tpop rcx\n\tsub rcx, rax\n\tmov rax, rcx\n");
+        } else if (i == DIV || i == MOD) {
+            fprintf(f, "\tpop rcx\n\txchg rax, rcx\n\tcqo\n\tidiv rcx\n");
+            if (i == MOD) {
+                fprintf(f, "\tmov rax, rdx\n");
+            }
+        } else if (i == SHL || i == SHR) {
+            fprintf(f, "\tpop rcx\n\txchg rax, rcx\n\t%s rax, cl\n",
+                    i == SHL ? "shl" : "sar");
+        } else if (i >= EQ && i <= GE) {
+            fprintf(f, "\tpop rcx\n\tcmp rcx, rax\n\tset%s al\n"
+                       "\tmovzx eax, al\n",
+                    &"e\0\0ne\0l\0\0g\0\0le\0ge"[(i - EQ) * 3]);
+        } else if (i >= OR && i <= MUL) {
+            fprintf(f, "\tpop rcx\n\t%s rax, rcx\n",
+                    i == OR ? "or" : i == XOR ? "xor" : i == AND ? "and"
+                    : i == ADD ? "add" : "imul");
+        } else if (i >= OPEN && i <= MCMP) {
+            // like jsys(): the arguments stay where the VM pushed them
+            fprintf(f, "\tmov rbx, rsp\n\tand rsp, -16\n");
+            n = i == PRTF ? (*t == ADJ ? t[1] : 0)
+                : i == OPEN ? 2 : i == CLOS || i == MALC || i == FREE ? 1 : 3;
+            k = 0;
+            while (k < (i == PRTF ? 6 : n)) {
+                farg(f, k, (n - 1 - k) * 8);
+                ++k;
+            }
+            if (i == FREE) {
+                fprintf(f, "\tmov r12, rax\n");
+            }
+            fcall(f, i == OPEN ? "open" : i == READ ? "read"
+                     : i == CLOS ? "close" : i == WRIT ? "bfcc.write"
+                     : i == PRTF ? "bfcc.printf" : i == MALC ? "malloc"
+                     : i == FREE ? "free" : i == MSET ? "memset" : "memcmp");
+            if (i == OPEN || i == CLOS || i == MCMP) {
+                fprintf(f, "\tmovsxd rax, eax\n");
+            } else if (i == FREE) {
+                fprintf(f, "\tmov rax, r12\n");
+            }
         } else if (i == EXIT) {
-            printf("exit(%d) cycle = %d\n", *sp, cycle);
-            return *sp;
+            fprintf(f, "\tmov rdi, [rsp]\n\tand rsp, -16\n\tcall exit@PLT\n");
         } else {
-            printf("unknown instruction = %d, cycle = %d\n", i, cycle);
+            printf("native: unknown instruction = %ld\n", i);
+            fclose(f);
+            free(tgt);
             return -1;
         }
     }
+    fsize(f, fn);
 
+    // the data segment: string literals and zeroed globals
+    fprintf(f, "\t.data\n\t.balign 16\nbfcc.data:\n");
+    s = dbase;
+    while (s < data) {
+        n = 0;
+        while (s + n < data && !s[n]) {
+            ++n;
+        }
+        if (n >= 8 || s + n == data) {
+            fprintf(f, "\t.zero %ld\n", n);
+            s = s + n;
+            continue;
+        }
+        fprintf(f, "\t.byte %d", (unsigned char) *s++);
+        n = 1;
+        while (s < data && n++ < 16) {
+            fprintf(f, ",%d", (unsigned char) *s++);
+        }
+        fprintf(f, "\n");
+    }
+    fprintf(f, "\t.zero 8\n\t.section .note.GNU-stack,\"\",@progbits\n");
+    free(tgt);
+    if (fclose(f)) {
+        printf("could not write(%s)\n", file);
+        return -1;
+    }
     return 0;
 }
+
+// -p: number the functions (every JSR target and main) and set up the
+// counters. The shadow stack is an arena so deep recursion stays cheap.
+void pinit(int *entry, int stksz)
+{
+    int *t, i, n;
+
+    n = e - text + 1;
+    pcount = (int *) arena((EXIT + 1) * sizeof(int), "profile");
+    pfn = (int *) arena(n * sizeof(int), "profile");
+    pfn[entry - text] = 1;
+    t = text + 1;
+    while (t <= e) {
+        i = *t++;
+        if (i == JSR || i == TSR) {
+            pfn[(int *) *t - text] = 1;
+        }
+        if (i < LEV) {
+            ++t;
+        }
+    }
+    nfn = 0;
+    i = 0;
+    while (i < n) {
+        if (pfn[i]) {
+            pfn[i] = ++nfn;
+        }
+        ++i;
+    }
+    pent = (int *) arena(nfn * 7 * sizeof(int), "profile");
+    pcalls = pent + nfn;
+    pself = pcalls + nfn;
+    ptotal = pself + nfn;
+    pdepth = ptotal + nfn;
+    i = 0;
+    while (i < n) {
+        if (pfn[i]) {
+            pent[pfn[i] - 1] = i;
+        }
+        ++i;
+    }
+    // two words per call, it must not run out before the VM stack does
+    psz = 2 * stksz;
+    psp = pstk = (int *) arena(psz, "profile");
+
+    pcur = pfn[entry - text] - 1;
+    pcalls[pcur] = pdepth[pcur] = 1;
+    *psp++ = pcur;
+    *psp++ = 0;
+}
+
+void penter(int *target, int cycle)
+{
+    *psp++ = pcur;
+    *psp++ = cycle;
+    pcur = pfn[target - text] - 1;
+    ++pcalls[pcur];
+    ++pdepth[pcur];
+}
+
+void pleave(int cycle)
+{
+    cycle = cycle - *--psp;
+    if (!--pdepth[pcur]) {
+        ptotal[pcur] = ptotal[pcur] + cycle;
+    }
+    pcur = *--psp;
+}
+
+// name of function k as a pointer into the source and its length in *n
+char *pname(int k, int *n)
+{
+    char *s;
+
+    id = sym;
+    while (id < sym + nsym * Idsz) {
+        if (id[Class] == Fun && (int *) id[Val] == text + pent[k]) {
+            s = (char *) id[Name];
+            *n = scan(s, Sid, 0) - s;
+            return s;
+        }
+        id = id + Idsz;
+    }
+    *n = 0;
+    return 0;
+}
+
+// sort the n indices in v by descending key[v[i]]
+void psort(int *v, int n, int *key)
+{
+    int i, j, k;
+
+    i = 1;
+    while (i < n) {
+        k = v[i];
+        j = i;
+        while (j > 0 && key[v[j - 1]] < key[k]) {
+            v[j] = v[j - 1];
+            --j;
+        }
+        v[j] = k;
+        ++i;
+    }
+}
+
+// print the profile, called at EXIT once every open call is closed
+// the run is over: give back what pinit() took, for -R to run the next
+// program without them piling up
+void pfree()
+{
+    if (pcount) {
+        release((char *) pcount, (EXIT + 1) * sizeof(int));
+    }
+    if (pfn) {
+        release((char *) pfn, (e - text + 1) * sizeof(int));
+    }
+    if (pent) {
+        release((char *) pent, nfn * 7 * sizeof(int));
+    }
+    if (pstk) {
+        release((char *) pstk, psz);
+    }
+    pcount = pfn = pent = pstk = 0;
+}
+
+void preport(int cycle)
+{
+    int *v, i, n;
+    char *s;
+    FILE *f;
+
+    while (psp > pstk) {
+        pleave(cycle);
+    }
+    if (!cycle) {
+        cycle = 1;
+    }
+    v = (int *) arena((nfn + EXIT + 1) * sizeof(int), "profile");
+
+    printf("\n%-10s %14s %7s\n", "opcode", "count", "%");
+    i = 0;
+    while (i <= EXIT) {
+        v[i] = i;
+        ++i;
+    }
+    psort(v, EXIT + 1, pcount);
+    i = 0;
+    while (i <= EXIT && pcount[v[i]]) {
+        printf("%-10.4s %14ld %6.2f%%\n", &ops[v[i] * 5], pcount[v[i]],
+               100.0 * pcount[v[i]] / cycle);
+        ++i;
+    }
+
+    printf("\n%-24s %10s %14s %7s %14s %7s\n", "function", "calls", "self",
+           "%", "total", "%");
+    i = 0;
+    while (i < nfn) {
+        v[i] = i;
+        ++i;
+    }
+    psort(v, nfn, pself);
+    i = 0;
+    while (i < nfn && pcalls[v[i]]) {
+        if (s = pname(v[i], &n)) {
+            printf("%-24.*s", (signed) n, s);
+        } else {
+            printf("sub_%-20ld", pent[v[i]]);
+        }
+        printf(" %10ld %14ld %6.2f%% %14ld %6.2f%%\n", pcalls[v[i]],
+               pself[v[i]], 100.0 * pself[v[i]] / cycle, ptotal[v[i]],
+               100.0 * ptotal[v[i]] / cycle);
+        ++i;
+    }
+    release((char *) v, (nfn + EXIT + 1) * sizeof(int));
+
+    if (!pjson) {
+        return;
+    }
+    if (!(f = fopen(pjson, "w"))) {
+        printf("could not open(%s)\n", pjson);
+        return;
+    }
+    fprintf(f, "{\n  \"cycles\": %ld,\n  \"opcodes\": {", cycle);
+    i = n = 0;
+    while (i <= EXIT) {
+        if (pcount[i]) {
+            fprintf(f, "%s\n    \"%.*s\": %ld", n++ ? "," : "",
+                    ops[i * 5 + 3] == ' ' ? (ops[i * 5 + 2] == ' ' ? 2 : 3) : 4,
+                    &ops[i * 5], pcount[i]);
+        }
+        ++i;
+    }
+    fprintf(f, "\n  },\n  \"functions\": [");
+    i = 0;
+    while (i < nfn) {
+        fprintf(f, "%s\n    {\"name\": \"", i ? "," : "");
+        if (s = pname(i, &n)) {
+            fprintf(f, "%.*s", (signed) n, s);
+        } else {
+            fprintf(f, "sub_%ld", pent[i]);
+        }
+        fprintf(f, "\", \"entry\": %ld, \"calls\": %ld, \"self\": %ld, "
+                   "\"total\": %ld}",
+                pent[i], pcalls[i], pself[i], ptotal[i]);
+        ++i;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+}
+
+// -F: count the stack of a sample at byte o of the engine's code, walked
+// up through the saved bp of every frame on the VM stack. Called from the
+// SIGPROF handler, so it takes no locks and allocates nothing.
+void srecord(int o, int *bp)
+{
+    int f[Sdepth], *s, n, h, k;
+
+    if (!sbuf) {
+        return;
+    }
+    ++nsample;
+    f[0] = o;
+    n = 1;
+    while (n < Sdepth && bp >= (int *) vstk && bp + 2 <= (int *) vend &&
+           (char *) bp[1] > xlo && (char *) bp[1] <= xhi) {
+        f[n++] = (char *) bp[1] - xlo - 1;
+        if ((int *) *bp <= bp) {
+            break;
+        }
+        bp = (int *) *bp;
+    }
+    h = n;
+    k = 0;
+    while (k < n) {
+        h = h * 31 + f[k++];
+    }
+    k = 0;
+    while (k < Sprobe) {
+        s = sbuf + ((h + k++) & (Sslot - 1)) * Ssz;
+        if (!s[1] || (s[1] == n && !memcmp(s + 2, f, n * sizeof(int)))) {
+            s[1] = n;
+            memcpy(s + 2, f, n * sizeof(int));
+            ++*s;
+            return;
+        }
+    }
+    ++sdrop;
+}
+
+// -F: SIGPROF. Native code has its pc and bp in the registers and is
+// sampled right away, at the last call into the host while it runs host
+// code. The interpreter keeps them to itself and is asked to take the
+// sample at its next call or branch instead.
+void sprof(signed sig, siginfo_t *si, void *uc)
+{
+    int *g;
+    char *pc;
+
+    if (!xmap) {
+        stick = 1;
+        return;
+    }
+#if defined(__x86_64__) && defined(REG_RIP)
+    g = (int *) ((ucontext_t *) uc)->uc_mcontext.gregs;
+    pc = (char *) g[REG_RIP];
+    if (pc >= xlo && pc < xhi) {
+        srecord(pc - xlo, (int *) g[REG_RBP]);
+    } else if (shost[0]) {
+        srecord(xmap[shost[1]] * xunit, (int *) shost[0]);
+    }
+#endif
+}
+
+pthread_once_t profonce = PTHREAD_ONCE_INIT;
+
+// the handler stays: a SIGPROF still pending when sampling stops would
+// otherwise end the process
+void profinit()
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = sprof;
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, 0);
+}
+
+// -F: start sampling the program whose main() is at pc
+void sstart(int *pc)
+{
+    struct itimerval it;
+
+    pthread_once(&profonce, profinit);
+    sbuf = (int *) arena(Sslot * Ssz * sizeof(int), "sample");
+    sroot = pc;
+    nsample = sdrop = shost[0] = stick = 0;
+    it.it_interval.tv_sec = it.it_value.tv_sec = 0;
+    it.it_interval.tv_usec = it.it_value.tv_usec = Stick;
+    setitimer(ITIMER_PROF, &it, 0);
+}
+
+// -F: byte offset of text index k in the engine's code
+int soff(int k)
+{
+    return xmap ? xmap[k] * xunit : k * sizeof(int);
+}
+
+// -F: the text index of the instruction whose code holds byte o, from the
+// n instruction starts in v, 0 if o is before the first
+int sfind(int *v, int n, int o)
+{
+    int lo, hi, m;
+
+    lo = 0;
+    hi = n;
+    while (lo < hi) {
+        m = (lo + hi) / 2;
+        if (soff(v[m]) <= o) {
+            lo = m + 1;
+        } else {
+            hi = m;
+        }
+    }
+    return lo ? v[lo - 1] : 0;
+}
+
+signed scmp(const void *a, const void *b)
+{
+    return strcmp((char *) (*(int **) a + 1), (char *) (*(int **) b + 1));
+}
+
+// -F: stop sampling and write one line per stack to the file, its frames
+// from main inward, each a function and the line it is at, then how often
+// it was seen: "main:9;fib:4;fib:5 37", the folded form flame graph tools
+// read. Stacks that differ only within a line are merged. Called by the
+// engine before it frees its code, whose offsets the samples are.
+void sreport()
+{
+    struct itimerval it;
+    int *s, *v, *fn, *fs, **l, *c, *d, n, m, nl, i, k, len;
+    char *q;
+    FILE *f;
+
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, 0);
+    s = sbuf;
+    sbuf = 0;
+    if (!s) {
+        return;
+    }
+
+    // instruction starts, the function each word is in, found from the
+    // named entries, main and whatever is called, and the symbol of each
+    // named entry
+    n = e - text + 1;
+    v = malloc(3 * n * sizeof(int));
+    l = malloc(Sslot * sizeof(int *));
+    if (!v || !l) {
+        printf("could not malloc(%ld) sample area\n", 3 * n * sizeof(int));
+        return;
+    }
+    fn = v + n;
+    fs = fn + n;
+    memset(fn, 0, 2 * n * sizeof(int));
+    fn[sroot - text] = 1;
+    m = 0;
+    c = text + 1;
+    while (c <= e) {
+        v[m++] = c - text;
+        if (*c == JSR || *c == TSR) {
+            fn[(int *) c[1] - text] = 1;
+        }
+        c = c + (*c < LEV ? 2 : 1);
+    }
+    id = sym;
+    while (id < sym + nsym * Idsz) {
+        if (id[Class] == Fun) {
+            fn[(int *) id[Val] - text] = 1;
+            fs[(int *) id[Val] - text] = (int) id;
+        }
+        id = id + Idsz;
+    }
+    k = 0;
+    i = 1;
+    while (i < n) {
+        k = fn[i] ? i : k;
+        fn[i++] = k;
+    }
+
+    // every stack as its count and folded line
+    nl = 0;
+    c = s;
+    while (c < s + Sslot * Ssz) {
+        if (*c) {
+            len = 0;
+            i = 0;
+            while (i < c[1]) {
+                d = (int *) fs[fn[sfind(v, m, c[2 + i++])]];
+                len = len + 48 + (d ? scan((char *) d[Name], Sid, 0) -
+                                          (char *) d[Name]
+                                    : 0);
+            }
+            if (!(l[nl] = malloc(sizeof(int) + len + 1))) {
+                break;
+            }
+            *l[nl] = *c;
+            q = (char *) (l[nl++] + 1);
+            i = c[1];
+            while (i-- > 0) {
+                if (!(k = sfind(v, m, c[2 + i]))) {
+                    continue;
+                }
+                if (q > (char *) (l[nl - 1] + 1)) {
+                    *q++ = ';';
+                }
+                if (d = (int *) fs[fn[k]]) {
+                    len = scan((char *) d[Name], Sid, 0) - (char *) d[Name];
+                    memcpy(q, (char *) d[Name], len);
+                    q = q + len;
+                } else {
+                    q = q + sprintf(q, "sub_%ld", fn[k]);
+                }
+                if (lineat(k)) {
+                    q = q + sprintf(q, ":%ld", lineat(k));
+                }
+            }
+            *q = 0;
+        }
+        c = c + Ssz;
+    }
+    qsort(l, nl, sizeof(int *), scmp);
+
+    if (!(f = fopen(pfold, "w"))) {
+        printf("could not open(%s)\n", pfold);
+    } else {
+        i = 0;
+        while (i < nl) {
+            k = *l[i];
+            while (i + 1 < nl && !scmp(l + i, l + i + 1)) {
+                k = k + *l[++i];
+            }
+            if (*(char *) (l[i] + 1)) {
+                fprintf(f, "%s %ld\n", (char *) (l[i] + 1), k);
+            }
+            ++i;
+        }
+        fclose(f);
+    }
+    if (sdrop) {
+        printf("-F: %ld of %ld samples dropped, too many stacks\n", sdrop,
+               nsample);
+    }
+    while (nl > 0) {
+        free(l[--nl]);
+    }
+    free(l);
+    free(v);
+    release((char *) s, Sslot * Ssz * sizeof(int));
+}
+
+// clang-format off
+// dispatch for run(): with GNU C every instruction is a label whose address
+// is stored in the translated text, otherwise fall back to a plain switch
+#ifdef __GNUC__
+#define OP(x)   op_##x:
+#define NEXT    ++cycle; goto *(void *) *pc++
+#else
+#define OP(x)   case x:
+#define NEXT    break
+#endif
+// clang-format on
+
+// direct-threaded interpreter, same semantics as the loop in main() but
+// without the per-instruction opcode comparison chain. For -T it runs the
+// task in task until that yields, and returns 0 then, or ends.
+int run(int *pc, int *sp)
+{
+    int *bp, a, cycle, end, i, k, *t, *code;
+    char *d;
+
+    bp = sp;
+    a = cycle = 0;
+    d = dbase;
+    code = 0;
+
+#ifdef __GNUC__
+    // clang-format off
+    static void *label[] = {
+        &&op_LEA, &&op_IMM, &&op_JMP, &&op_JSR, &&op_BZ,  &&op_BNZ,
+        &&op_BEQ, &&op_BNE, &&op_BLT, &&op_BGT, &&op_BLE, &&op_BGE, &&op_ENT, &&op_ADJ,
+        &&op_ADDI, &&op_MULI, &&op_SHLI, &&op_LLI, &&op_LLC, &&op_ADDP, &&op_LEAG,
+        &&op_TAIL, &&op_TSR, &&op_LEV, &&op_LI,  &&op_LC,  &&op_SI,  &&op_SC,  &&op_PSH,
+        &&op_OR,  &&op_XOR, &&op_AND, &&op_EQ,  &&op_NE,  &&op_LT,  &&op_GT,  &&op_LE,
+        &&op_GE,  &&op_SHL, &&op_SHR, &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_MOD,
+        &&op_OPEN, &&op_READ, &&op_CLOS, &&op_WRIT, &&op_PRTF, &&op_MALC, &&op_FREE,
+        &&op_MSET, &&op_MCMP, &&op_EXIT
+    };
+    // clang-format on
+
+    if (task && task[Tcode]) {
+        // -T: carry on where the task yielded
+        code = (int *) task[Tcode];
+        pc = (int *) task[Tpc];
+        sp = (int *) task[Tsp];
+        bp = (int *) task[Tbp];
+        a = task[Ta];
+        cycle = task[Tcycle];
+    } else {
+        // translate the text segment into handler addresses, branch
+        // targets are rewritten to point into the translated copy
+        if (!(code = malloc((e - text + 1) * sizeof(int)))) {
+            printf("could not malloc(%ld) threaded code area\n",
+                   (e - text + 1) * sizeof(int));
+            return -1;
+        }
+        t = text + 1;
+        while (t <= e) {
+            i = *t;
+            k = i == JMP || i == JSR || i == TSR || (i >= BZ && i <= BGE);
+            if (task) {
+                code[t - text] = (int) (k && (i == JSR || i == TSR ||
+                                              (int *) t[1] <= t)
+                                            ? &&yield
+                                            : label[i]);
+            } else {
+                code[t - text] =
+                    (int) (profile ? &&prof : sbuf && k ? &&tick : label[i]);
+            }
+            if (k) {
+                code[t - text + 1] = (int) (code + ((int *) t[1] - text));
+                t = t + 2;
+            } else if (i < LEV) {
+                code[t - text + 1] = t[1];
+                t = t + 2;
+            } else {
+                ++t;
+            }
+        }
+        pc = code + (pc - text);
+
+        // main() returns into PSH; EXIT, on the stack below argc
+        t = (int *) *sp;
+        t[0] = (int) label[PSH];
+        t[1] = (int) label[EXIT];
+        if (task) {
+            task[Tcode] = (int) code;
+        }
+    }
+    xlo = (char *) code;
+    xhi = (char *) (code + (e - text + 1));
+    end = task ? cycle + task[Tslice] : 0;
+
+    NEXT;
+
+    // -p: every instruction is translated to this stub instead, which
+    // accounts for it and then jumps to the real handler
+prof:
+    i = text[pc - 1 - code];
+    ++pcount[i];
+    ++pself[pcur];
+    if (i == JSR) {
+        penter((int *) text[pc - code], cycle);
+    } else if (i == TSR) {
+        pleave(cycle);
+        penter((int *) text[pc - code], cycle);
+    } else if (i == LEV) {
+        pleave(cycle);
+    }
+    if (stick) {
+        goto tick;
+    }
+    goto *label[i];
+
+    // -F: calls and branches are translated to this stub instead, which
+    // takes the sample SIGPROF asked for, if any, and then jumps to the
+    // real handler
+tick:
+    if (stick) {
+        stick = 0;
+        srecord((pc - 1 - code) * sizeof(int), bp);
+    }
+    goto *label[text[pc - 1 - code]];
+
+    // -T: the calls and backward jumps of a task are translated to this
+    // stub instead, which suspends the task once it has run for its slice,
+    // and then it is the next task's turn, or jumps to the real handler.
+    // The task resumes at the same instruction, whose cycle is counted
+    // then.
+yield:
+    if (cycle >= end) {
+        task[Tpc] = (int) (pc - 1);
+        task[Tsp] = (int) sp;
+        task[Tbp] = (int) bp;
+        task[Ta] = a;
+        task[Tcycle] = cycle - 1;
+        return 0;
+    }
+    goto *label[text[pc - 1 - code]];
+#else
+    if (profile) {
+        printf("-p needs computed goto\n");
+        return -1;
+    }
+    while (1) {
+        switch (*pc++) {
+#endif
+    // clang-format off
+    OP(LEA) a = (int) (bp + *pc++); NEXT;
+    OP(IMM) a = *pc++; NEXT;
+    OP(JMP) pc = (int *) *pc; NEXT;
+    OP(JSR) *--sp = (int) (pc + 1); pc = (int *) *pc; NEXT;
+    OP(BZ) pc = a ? pc + 1 : (int *) *pc; NEXT;
+    OP(BNZ) pc = a ? (int *) *pc : pc + 1; NEXT;
+    OP(BEQ) pc = *sp++ == a ? (int *) *pc : pc + 1; NEXT;
+    OP(BNE) pc = *sp++ != a ? (int *) *pc : pc + 1; NEXT;
+    OP(BLT) pc = *sp++ < a ? (int *) *pc : pc + 1; NEXT;
+    OP(BGT) pc = *sp++ > a ? (int *) *pc : pc + 1; NEXT;
+    OP(BLE) pc = *sp++ <= a ? (int *) *pc : pc + 1; NEXT;
+    OP(BGE) pc = *sp++ >= a ? (int *) *pc : pc + 1; NEXT;
+    OP(ENT) *--sp = (int) bp; bp = sp; sp = sp - *pc++; NEXT;
+    OP(ADJ) sp = sp + *pc++; NEXT;
+    OP(ADDI) a = a + *pc++; NEXT;
+    OP(MULI) a = a * *pc++; NEXT;
+    OP(SHLI) a = a << *pc++; NEXT;
+    OP(LLI) a = bp[*pc++]; NEXT;
+    OP(LLC) a = *(char *) (bp + *pc++); NEXT;
+    OP(ADDP) a = *sp++ + (a << *pc++); NEXT;
+    OP(LEAG) a = (int) (d + *pc++); NEXT;
+    OP(TAIL)
+        i = *pc++;
+        while (i--) {
+            bp[2 + i] = sp[i];
+        }
+        NEXT;
+    OP(TSR) t = bp; bp = (int *) *t; sp = t + 1; pc = (int *) *pc; NEXT;
+    OP(LEV) sp = bp; bp = (int *) *sp++; pc = (int *) *sp++; NEXT;
+    OP(LI) a = *(int *) a; NEXT;
+    OP(LC) a = *(char *) a; NEXT;
+    OP(SI) *(int *) *sp++ = a; NEXT;
+    OP(SC) a = *(char *) *sp++ = a; NEXT;
+    OP(PSH) *--sp = a; NEXT;
+
+    OP(OR) a = *sp++ | a; NEXT;
+    OP(XOR) a = *sp++ ^ a; NEXT;
+    OP(AND) a = *sp++ & a; NEXT;
+    OP(EQ) a = *sp++ == a; NEXT;
+    OP(NE) a = *sp++ != a; NEXT;
+    OP(LT) a = *sp++ < a; NEXT;
+    OP(GT) a = *sp++ > a; NEXT;
+    OP(LE) a = *sp++ <= a; NEXT;
+    OP(GE) a = *sp++ >= a; NEXT;
+    OP(SHL) a = *sp++ << a; NEXT;
+    OP(SHR) a = *sp++ >> a; NEXT;
+    OP(ADD) a = *sp++ + a; NEXT;
+    OP(SUB) a = *sp++ - a; NEXT;
+    OP(MUL) a = *sp++ * a; NEXT;
+    OP(DIV) a = *sp++ / a; NEXT;
+    OP(MOD) a = *sp++ % a; NEXT;
+
+    // system function call
+    OP(OPEN) a = open((char *) sp[1], *sp); NEXT;
+    OP(READ) a = read(sp[2], (char *) sp[1], *sp); NEXT;
+    OP(CLOS) a = close(*sp); NEXT;
+    OP(WRIT) a = owrite(sp[2], (char *) sp[1], *sp); NEXT;
+    OP(PRTF)
+        t = sp + pc[1];
+        a = oprintf((char *) t[-1], t[-2], t[-3], t[-4], t[-5], t[-6]);
+        NEXT;
+    OP(MALC) a = (int) vmalloc(*sp); NEXT;
+    OP(FREE) vfree((char *) *sp); NEXT;
+    OP(MSET) a = (int) memset((char *) sp[2], sp[1], *sp); NEXT;
+    OP(MCMP) a = memcmp((char *) sp[2], (char *) sp[1], *sp); NEXT;
+    OP(EXIT)
+        oflush();
+        if (!quiet) {
+            printf("exit(%ld) cycle = %ld\n", *sp, cycle);
+        }
+        ncycle = cycle;
+        if (profile) {
+            preport(cycle);
+        }
+        sreport();
+        free(code);
+        if (task) {
+            task[Tcode] = 0;
+        }
+        return *sp;
+    // clang-format on
+#ifndef __GNUC__
+    default:
+        printf("unknown instruction = %ld, cycle = %ld\n", pc[-1], cycle);
+        return -1;
+        }
+        ++cycle;
+    }
+#endif
+}
+
+// reference interpreter, also used for -d tracing
+int interp(int *pc, int *sp)
+{
+    int *bp, a, cycle, i, *t;
+
+    bp = sp;
+    a = 0;
+    cycle = 0;
+    while (1) {
+        i = *pc++;
+        ++cycle;
+        if (debug) {
+            printf("%ld> %.4s", cycle, &ops[i * 5]);
+            if (i < LEV) {
+                printf(" %ld\n", *pc);
+            } else {
+                printf("\n");
+            }
+        }
+
+        if (i == LEA) {
+            // load local address
+            a = (int) (bp + *pc++);
+        } else if (i == IMM) {
+            // load global address or immediate
+            a = *pc++;
+        } else if (i == JMP) {
+            // jump
+            pc = (int *) *pc;
+        } else if (i == JSR) {
+            // jump to subroutine
+            *--sp = (int) (pc + 1);
+            pc = (int *) *pc;
+        } else if (i == TAIL) {
+            // move the arguments of a tail call over the parameters
+            t = sp + *pc++;
+            while (t > sp) {
+                --t;
+                bp[2 + (t - sp)] = *t;
+            }
+        } else if (i == TSR) {
+            // tail call: drop the frame, keep the return address
+            t = bp;
+            bp = (int *) *t;
+            sp = t + 1;
+            pc = (int *) *pc;
+        } else if (i == BZ) {
+            // branch if zero
+            pc = a ? pc + 1 : (int *) *pc;
+        } else if (i == BNZ) {
+            // branch if not zero
+            pc = a ? (int *) *pc : pc + 1;
+        } else if (i >= BEQ && i <= BGE) {
+            // compare and branch if true
+            t = (int *) *sp++;
+            if (i == BEQ ? (int) t == a
+                : i == BNE ? (int) t != a
+                : i == BLT ? (int) t < a
+                : i == BGT ? (int) t > a
+                : i == BLE ? (int) t <= a
+                           : (int) t >= a) {
+                pc = (int *) *pc;
+            } else {
+                ++pc;
+            }
+        } else if (i == ENT) {
+            // enter subroutine
+            *--sp = (int) bp;
+            bp = sp;
+            sp = sp - *pc++;
+        } else if (i == ADJ) {
+            // stack adjust
+            sp = sp + *pc++;
+        } else if (i == ADDI) {
+            // add immediate
+            a = a + *pc++;
+        } else if (i == MULI) {
+            // multiply by immediate
+            a = a * *pc++;
+        } else if (i == SHLI) {
+            // shift left by immediate
+            a = a << *pc++;
+        } else if (i == LLI) {
+            // load local int
+            a = bp[*pc++];
+        } else if (i == LLC) {
+            // load local char
+            a = *(char *) (bp + *pc++);
+        } else if (i == ADDP) {
+            // add scaled index to pointer
+            a = *sp++ + (a << *pc++);
+        } else if (i == LEAG) {
+            // load global address
+            a = (int) (dbase + *pc++);
+        } else if (i == LEV) {
+            // leave subroutine
+            sp = bp;
+            bp = (int *) *sp++;
+            pc = (int *) *sp++;
+        } else if (i == LI) {
+            // load int
+            a = *(int *) a;
+        } else if (i == LC) {
+            // load char
+            a = *(char *) a;
+        } else if (i == SI) {
+            // store int
+            *(int *) *sp++ = a;
+        } else if (i == SC) {
+            // store char
+            a = *(char *) *sp++ = a;
+        } else if (i == PSH) {
+            // push
+            *--sp = a;
+        }
+
+        else if (i == OR) {
+            a = *sp++ | a;
+        } else if (i == XOR) {
+            a = *sp++ ^ a;
+        } else if (i == AND) {
+            a = *sp++ & a;
+        } else if (i == EQ) {
+            a = *sp++ == a;
+        } else if (i == NE) {
+            a = *sp++ != a;
+        } else if (i == LT) {
+            a = *sp++ < a;
+        } else if (i == GT) {
+            a = *sp++ > a;
+        } else if (i == LE) {
+            a = *sp++ <= a;
+        } else if (i == GE) {
+            a = *sp++ >= a;
+        } else if (i == SHL) {
+            a = *sp++ << a;
+        } else if (i == SHR) {
+            a = *sp++ >> a;
+        } else if (i == ADD) {
+            a = *sp++ + a;
+        } else if (i == SUB) {
+            a = *sp++ - a;
+        } else if (i == MUL) {
+            a = *sp++ * a;
+        } else if (i == DIV) {
+            a = *sp++ / a;
+        } else if (i == MOD) {
+            a = *sp++ % a;
+        }
+        // system function call
+        else if (i == OPEN) {
+            a = open((char *) sp[1], *sp);
+        } else if (i == READ) {
+            a = read(sp[2], (char *) sp[1], *sp);
+        } else if (i == CLOS) {
+            a = close(*sp);
+        } else if (i == WRIT) {
+            a = owrite(sp[2], (char *) sp[1], *sp);
+        } else if (i == PRTF) {
+            t = sp + pc[1];
+            a = oprintf((char *) t[-1], t[-2], t[-3], t[-4], t[-5], t[-6]);
+        } else if (i == MALC) {
+            a = (int) vmalloc(*sp);
+        } else if (i == FREE) {
+            vfree((char *) *sp);
+        } else if (i == MSET) {
+            a = (int) memset((char *) sp[2], sp[1], *sp);
+        } else if (i == MCMP) {
+            a = memcmp((char *) sp[2], (char *) sp[1], *sp);
+        } else if (i == EXIT) {
+            oflush();
+            if (!quiet) {
+                printf("exit(%ld) cycle = %ld\n", *sp, cycle);
+            }
+            ncycle = cycle;
+            return *sp;
+        } else {
+            printf("unknown instruction = %ld, cycle = %ld\n", i, cycle);
+            return -1;
+        }
+    }
+}
+
+// clang-format off
+// register tier (-r): a three-address form of the text segment with its
+// own interpreter. Every instruction is four words, the opcode and up to
+// three operands d, x and y. Register operands are word offsets from bp:
+// parameters, locals and, below the locals, one temporary per expression
+// stack depth. Ops ending in I take the immediate y instead of a register.
+enum {
+    RMOV, RIMM, RLEA, RLEAG, RLI, RLC, RLLC, RLGI, RLGC,
+    RSI, RSC, RSLC, RSGI, RSGC, RJMP, RBZ, RBNZ, RJSR, RENT, RRET, RTAIL, RTSR,
+    ROR,  RXOR,  RAND,  REQ,  RNE,  RLT,  RGT,  RLE,  RGE,  RSHL,  RSHR,  RADD,  RSUB,  RMUL,  RDIV,  RMOD,
+    RORI, RXORI, RANDI, REQI, RNEI, RLTI, RGTI, RLEI, RGEI, RSHLI, RSHRI, RADDI, RSUBI, RMULI, RDIVI, RMODI,
+    ROPEN, RREAD, RCLOS, RWRIT, RPRTF, RMALC, RFREE, RMSET, RMCMP, REXIT, RHALT
+};
+
+// register tier opcode names for -s, six characters per entry
+char *rops =
+    "MOV  ,IMM  ,LEA  ,LEAG ,LI   ,LC   ,LLC  ,LGI  ,LGC  ,"
+    "SI   ,SC   ,SLC  ,SGI  ,SGC  ,JMP  ,BZ   ,BNZ  ,JSR  ,ENT  ,RET  ,TAIL ,TSR  ,"
+    "OR   ,XOR  ,AND  ,EQ   ,NE   ,LT   ,GT   ,LE   ,GE   ,SHL  ,SHR  ,ADD  ,SUB  ,MUL  ,DIV  ,MOD  ,"
+    "ORI  ,XORI ,ANDI ,EQI  ,NEI  ,LTI  ,GTI  ,LEI  ,GEI  ,SHLI ,SHRI ,ADDI ,SUBI ,MULI ,DIVI ,MODI ,"
+    "OPEN ,READ ,CLOS ,WRIT ,PRTF ,MALC ,FREE ,MSET ,MCMP ,EXIT ,HALT ,";
+
+// where the translator keeps a value it has not yet moved into a register:
+// in a register already, an immediate, a local or a global address
+enum { Vreg, Vimm, Vloc, Vglo };
+// clang-format on
+
+// -r: temporary register of expression stack depth i
+int rtmp(int i)
+{
+    return -(rloc + 1 + i);
+}
+
+// -r: append an instruction to the register code
+int *remit(int op, int d, int x, int y)
+{
+    if (re + 4 > rend) {
+        printf("register code area full\n");
+        fail();
+    }
+    rlast = 0;
+    re[0] = op;
+    re[1] = d;
+    re[2] = x;
+    re[3] = y;
+    re = re + 4;
+    return re - 4;
+}
+
+// -r: the register holding a value, moving it into temporary i if needed
+int rget(int k, int v, int i)
+{
+    if (k == Vreg) {
+        return v;
+    }
+    remit(k == Vimm ? RIMM : k == Vloc ? RLEA : RLEAG, rtmp(i), v, 0);
+    return rtmp(i);
+}
+
+// -r: read the stack entries below depth n that still name a local or a
+// parameter into their temporaries, before a store, call or branch could
+// change the variable behind them
+void rflush(int n)
+{
+    int i;
+
+    i = 0;
+    while (i < n) {
+        if (rk[i] == Vreg && rv[i] != rtmp(i)) {
+            remit(RMOV, rtmp(i), rv[i], 0);
+            rv[i] = rtmp(i);
+        }
+        ++i;
+    }
+}
+
+// -r: move the accumulator into the temporary of the current depth, which
+// is where every path into a join point leaves it
+void rsettle()
+{
+    int r;
+
+    if ((r = rget(ak, av, rdep)) != rtmp(rdep)) {
+        remit(RMOV, rtmp(rdep), r, 0);
+    }
+    ak = Vreg;
+    av = rtmp(rdep);
+}
+
+// -r: pop the left operand of a binary stack op o and combine it with the
+// accumulator into the temporary of the new depth
+void rbin(int o)
+{
+    int lk, lv, x;
+
+    --rdep;
+    lk = rk[rdep];
+    lv = rv[rdep];
+    if (lk == Vimm && ak != Vimm &&
+        (o == OR || o == XOR || o == AND || o == EQ || o == NE || o == ADD ||
+         o == MUL || o == LT || o == GT || o == LE || o == GE)) {
+        // k op x == x op' k
+        x = rget(ak, av, rdep + 1);
+        ak = Vimm;
+        av = lv;
+        lk = Vreg;
+        lv = x;
+        o = o == LT ? GT : o == GT ? LT : o == LE ? GE : o == GE ? LE : o;
+    }
+    x = rget(lk, lv, rdep);
+    if (ak == Vimm) {
+        rlast = remit(RORI + o - OR, rtmp(rdep), x, av);
+    } else {
+        rlast = remit(ROR + o - OR, rtmp(rdep), x, rget(ak, av, rdep + 1));
+    }
+    ak = Vreg;
+    av = rtmp(rdep);
+}
+
+// -r: translate the text segment into register code, return the address
+// of the instruction that entry was translated to. Every stack op is
+// replayed against a model of the expression stack, so that pushes and
+// pops turn into register numbers and reads of locals, immediates and
+// addresses fold into the operands of the op that consumes them.
+int *rtrans(int *entry)
+{
+    int *c, *t, *map, *tgt, *fix, *f, n, i, k, r, max;
+
+    n = e - text + 2;
+    if (!(map = malloc(n * sizeof(int))) || !(tgt = malloc(n * sizeof(int))) ||
+        !(f = fix = malloc(n * sizeof(int))) ||
+        !(rk = malloc(n * sizeof(int))) || !(rv = malloc(n * sizeof(int)))) {
+        printf("could not malloc(%ld) register tier area\n", n * sizeof(int));
+        fail();
+    }
+    memset(tgt, 0, n * sizeof(int));
+    c = text + 1;
+    while (c <= e) {
+        if (*c == JMP || (*c >= BZ && *c <= BGE)) {
+            tgt[(int *) c[1] - text] = 1;
+        }
+        c = c + (*c < LEV ? 2 : 1);
+    }
+    rtext = re = (int *) arena(n * 16 * sizeof(int) + 4096, "register code");
+    rend = rtext + n * 16;
+
+    rloc = rdep = 0;
+    ak = Vimm;
+    av = 0;
+    c = text + 1;
+    while (c <= e) {
+        i = *c;
+        if (tgt[c - text]) {
+            // a join point: the branches into it already left the model in
+            // this shape, bring the fall-through edge in line
+            rflush(rdep);
+            if (alive(c)) {
+                rsettle();
+            } else {
+                ak = Vimm;
+            }
+            rlast = 0;
+        }
+        map[c - text] = re - rtext;
+
+        if (i == ENT) {
+            // size the temporaries from the deepest stack in the function
+            rloc = c[1];
+            rdep = max = 0;
+            t = c + 2;
+            while (t <= e && *t != ENT) {
+                k = *t;
+                if (k == PSH) {
+                    if (++rdep > max) {
+                        max = rdep;
+                    }
+                } else if ((k >= OR && k <= MOD) || k == SI || k == SC ||
+                           k == ADDP || (k >= BEQ && k <= BGE)) {
+                    --rdep;
+                } else if (k == ADJ || k == TAIL) {
+                    rdep = rdep - t[1];
+                }
+                t = t + (k < LEV ? 2 : 1);
+            }
+            rdep = 0;
+            ak = Vimm;
+            av = 0;
+            remit(RENT, 0, 0, max + 2);
+        } else if (i == LEA) {
+            ak = Vloc;
+            av = c[1];
+        } else if (i == IMM) {
+            ak = Vimm;
+            av = c[1];
+        } else if (i == LEAG) {
+            ak = Vglo;
+            av = c[1];
+        } else if (i == LLI) {
+            ak = Vreg;
+            av = c[1];
+        } else if (i == LLC) {
+            rlast = remit(RLLC, rtmp(rdep), c[1], 0);
+            ak = Vreg;
+            av = rtmp(rdep);
+        } else if (i == LI || i == LC) {
+            if (ak == Vloc && i == LI) {
+                ak = Vreg;
+            } else {
+                if (ak == Vloc) {
+                    rlast = remit(RLLC, rtmp(rdep), av, 0);
+                } else if (ak == Vglo) {
+                    rlast = remit(i == LI ? RLGI : RLGC, rtmp(rdep), av, 0);
+                } else {
+                    r = rget(ak, av, rdep);
+                    rlast = remit(i == LI ? RLI : RLC, rtmp(rdep), r, 0);
+                }
+                ak = Vreg;
+                av = rtmp(rdep);
+            }
+        } else if (i == PSH) {
+            rk[rdep] = ak;
+            rv[rdep] = av;
+            if (ak == Vreg && av < -rloc && av != rtmp(rdep)) {
+                // a temporary of another depth is copied, never shared
+                remit(RMOV, rtmp(rdep), av, 0);
+                rv[rdep] = rtmp(rdep);
+            }
+            ++rdep;
+        } else if (i == SI || i == SC) {
+            --rdep;
+            rflush(rdep);
+            k = rk[rdep];
+            if (i == SI && k == Vloc && rlast && ak == Vreg && rlast[1] == av &&
+                av < -rloc) {
+                // the value was just computed into a temporary: compute it
+                // straight into the local instead
+                rlast[1] = rv[rdep];
+                av = rv[rdep];
+            } else if (i == SI && k == Vloc) {
+                remit(RMOV, rv[rdep], rget(ak, av, rdep + 1), 0);
+            } else if (i == SI && k == Vglo) {
+                remit(RSGI, 0, rv[rdep], rget(ak, av, rdep + 1));
+            } else if (i == SI) {
+                r = rget(k, rv[rdep], rdep);
+                remit(RSI, 0, r, rget(ak, av, rdep + 1));
+            } else {
+                r = rget(ak, av, rdep + 1);
+                if (k == Vloc || k == Vglo) {
+                    remit(k == Vloc ? RSLC : RSGC, rtmp(rdep), rv[rdep], r);
+                } else {
+                    remit(RSC, rtmp(rdep), rget(k, rv[rdep], rdep), r);
+                }
+                ak = Vreg;
+                av = rtmp(rdep);
+            }
+        } else if (i >= OR && i <= MOD) {
+            rbin(i);
+        } else if (i == ADDI || i == MULI || i == SHLI) {
+            if (ak == Vimm) {
+                av = i == ADDI ? av + c[1] : i == MULI ? av * c[1] : av << c[1];
+            } else if (ak == Vglo && i == ADDI) {
+                av = av + c[1];
+            } else {
+                r = rget(ak, av, rdep);
+                rlast = remit(i == ADDI ? RADDI : i == MULI ? RMULI : RSHLI,
+                              rtmp(rdep), r, c[1]);
+                ak = Vreg;
+                av = rtmp(rdep);
+            }
+        } else if (i == ADDP) {
+            if (ak == Vimm) {
+                av = av << c[1];
+            } else if (c[1]) {
+                r = rget(ak, av, rdep);
+                remit(RSHLI, rtmp(rdep), r, c[1]);
+                ak = Vreg;
+                av = rtmp(rdep);
+            }
+            rbin(ADD);
+        } else if (i == JMP || (i >= BZ && i <= BGE)) {
+            if (i >= BEQ) {
+                // the comparison into a temporary, then BNZ on it
+                rbin(EQ + i - BEQ);
+                i = BNZ;
+            }
+            rflush(rdep);
+            t = (int *) c[1];
+            if (alive(t)) {
+                rsettle();
+            }
+            if (i == JMP) {
+                remit(RJMP, 0, t - text, 0);
+            } else {
+                remit(i == BZ ? RBZ : RBNZ, rget(ak, av, rdep), t - text, 0);
+            }
+            *f++ = re - rtext - 2;
+        } else if (i == JSR || i == TAIL || (i >= OPEN && i <= EXIT)) {
+            // arguments go to the temporaries of their depths, which lie
+            // in memory exactly as the stack machine would have pushed them
+            if (i == TAIL) {
+                k = c[1];
+            } else {
+                k = c[i == JSR ? 2 : 1] == ADJ ? c[i == JSR ? 3 : 2] : 0;
+            }
+            rflush(rdep);
+            r = rdep - k;
+            while (r < rdep) {
+                if (rk[r] != Vreg) {
+                    remit(rk[r] == Vimm ? RIMM : rk[r] == Vloc ? RLEA : RLEAG,
+                          rtmp(r), rv[r], 0);
+                }
+                ++r;
+            }
+            if (i == JSR) {
+                remit(RJSR, rtmp(rdep - k), -(rloc + rdep),
+                      (int *) c[1] - text);
+                *f++ = re - rtext - 1;
+            } else if (i == TAIL) {
+                remit(RTAIL, 0, -(rloc + rdep), k);
+            } else {
+                remit(ROPEN + i - OPEN, rtmp(rdep - k), -(rloc + rdep), k);
+            }
+            rdep = rdep - k;
+            ak = Vreg;
+            av = rtmp(rdep);
+            if (k && i != TAIL) {
+                c = c + 2;
+                map[c - text] = re - rtext;
+            }
+        } else if (i == TSR) {
+            remit(RTSR, 0, (int *) c[1] - text, 0);
+            *f++ = re - rtext - 2;
+        } else if (i == ADJ) {
+            rdep = rdep - c[1];
+        } else if (i == LEV) {
+            remit(RRET, 0, rget(ak, av, rdep), 0);
+        }
+        c = c + (i < LEV ? 2 : 1);
+    }
+
+    // branch operands become addresses in the register code
+    t = fix;
+    while (t < f) {
+        rtext[*t] = (int) (rtext + map[rtext[*t]]);
+        ++t;
+    }
+    t = rtext + map[entry - text];
+    free(rmap);
+    rmap = map;
+    free(tgt);
+    free(fix);
+    free(rk);
+    free(rv);
+    return t;
+}
+
+// -s: list the register code
+void rdump(int *entry)
+{
+    int *c;
+
+    c = rtext;
+    while (c < re) {
+        printf("%s%6ld  %.5s %ld, ", c == entry ? ">" : " ",
+               (int) (c - rtext) / 4, &rops[*c * 6], c[1]);
+        // branch targets as instruction numbers
+        if (*c == RJMP || *c == RBZ || *c == RBNZ || *c == RTSR) {
+            printf("@%ld, %ld\n", ((int *) c[2] - rtext) / 4, c[3]);
+        } else if (*c == RJSR) {
+            printf("%ld, @%ld\n", c[2], ((int *) c[3] - rtext) / 4);
+        } else {
+            printf("%ld, %ld\n", c[2], c[3]);
+        }
+        c = c + 4;
+    }
+}
+
+// register tier interpreter: each handler reads its operands from pc[0..2]
+// and RNEXT steps over them
+#define RNEXT   pc = pc + 3; NEXT
+
+int rrun(int *pc, int *sp)
+{
+    int *bp, a, cycle, *t;
+    char *d;
+
+    bp = sp;
+    a = cycle = 0;
+    d = dbase;
+
+#ifdef __GNUC__
+    // clang-format off
+    static void *label[] = {
+        &&op_RMOV, &&op_RIMM, &&op_RLEA, &&op_RLEAG, &&op_RLI, &&op_RLC, &&op_RLLC,
+        &&op_RLGI, &&op_RLGC, &&op_RSI, &&op_RSC, &&op_RSLC, &&op_RSGI, &&op_RSGC,
+        &&op_RJMP, &&op_RBZ, &&op_RBNZ, &&op_RJSR, &&op_RENT, &&op_RRET,
+        &&op_RTAIL, &&op_RTSR,
+        &&op_ROR, &&op_RXOR, &&op_RAND, &&op_REQ, &&op_RNE, &&op_RLT, &&op_RGT,
+        &&op_RLE, &&op_RGE, &&op_RSHL, &&op_RSHR, &&op_RADD, &&op_RSUB, &&op_RMUL,
+        &&op_RDIV, &&op_RMOD,
+        &&op_RORI, &&op_RXORI, &&op_RANDI, &&op_REQI, &&op_RNEI, &&op_RLTI, &&op_RGTI,
+        &&op_RLEI, &&op_RGEI, &&op_RSHLI, &&op_RSHRI, &&op_RADDI, &&op_RSUBI, &&op_RMULI,
+        &&op_RDIVI, &&op_RMODI,
+        &&op_ROPEN, &&op_RREAD, &&op_RCLOS, &&op_RWRIT, &&op_RPRTF, &&op_RMALC,
+        &&op_RFREE,
+        &&op_RMSET, &&op_RMCMP, &&op_REXIT, &&op_RHALT
+    };
+    // clang-format on
+#endif
+    int halt[8];
+
+    // main() returns into a call whose result slot is harmless, then halts
+    xlo = (char *) rtext;
+    xhi = (char *) re;
+    xmap = rmap;
+    xunit = sizeof(int);
+
+    halt[0] = RJSR;
+    halt[1] = halt[2] = halt[3] = 0;
+    halt[4] = RHALT;
+    *sp = (int) (halt + 4);
+
+#ifdef __GNUC__
+    // opcodes become handler addresses in place
+    t = rtext;
+    while (t < re) {
+        *t = (int) label[*t];
+        t = t + 4;
+    }
+    halt[0] = (int) label[RJSR];
+    halt[4] = (int) label[RHALT];
+
+    NEXT;
+#else
+    while (1) {
+        switch (*pc++) {
+#endif
+    // clang-format off
+    OP(RMOV) bp[pc[0]] = bp[pc[1]]; RNEXT;
+    OP(RIMM) bp[pc[0]] = pc[1]; RNEXT;
+    OP(RLEA) bp[pc[0]] = (int) (bp + pc[1]); RNEXT;
+    OP(RLEAG) bp[pc[0]] = (int) (d + pc[1]); RNEXT;
+    OP(RLI) bp[pc[0]] = *(int *) bp[pc[1]]; RNEXT;
+    OP(RLC) bp[pc[0]] = *(char *) bp[pc[1]]; RNEXT;
+    OP(RLLC) bp[pc[0]] = *(char *) (bp + pc[1]); RNEXT;
+    OP(RLGI) bp[pc[0]] = *(int *) (d + pc[1]); RNEXT;
+    OP(RLGC) bp[pc[0]] = *(char *) (d + pc[1]); RNEXT;
+    OP(RSI) *(int *) bp[pc[1]] = bp[pc[2]]; RNEXT;
+    OP(RSC) bp[pc[0]] = *(char *) bp[pc[1]] = bp[pc[2]]; RNEXT;
+    OP(RSLC) bp[pc[0]] = *(char *) (bp + pc[1]) = bp[pc[2]]; RNEXT;
+    OP(RSGI) *(int *) (d + pc[1]) = bp[pc[2]]; RNEXT;
+    OP(RSGC) bp[pc[0]] = *(char *) (d + pc[1]) = bp[pc[2]]; RNEXT;
+    OP(RJMP) pc = (int *) pc[1]; NEXT;
+    OP(RBZ) pc = bp[pc[0]] ? pc + 3 : (int *) pc[1]; NEXT;
+    OP(RBNZ) pc = bp[pc[0]] ? (int *) pc[1] : pc + 3; NEXT;
+    OP(RJSR) sp = bp + pc[1]; *--sp = (int) (pc + 3); pc = (int *) pc[2]; NEXT;
+    OP(RENT) *--sp = (int) bp; bp = sp; RNEXT;
+    // the caller's result slot is the d operand of the RJSR it returns past
+    OP(RRET)
+        a = bp[pc[1]];
+        sp = bp; bp = (int *) *sp++; pc = (int *) *sp++;
+        bp[pc[-3]] = a;
+        NEXT;
+    OP(RTAIL)
+        t = bp + pc[1];
+        a = pc[2];
+        while (a--) {
+            bp[2 + a] = t[a];
+        }
+        RNEXT;
+    OP(RTSR) t = bp; bp = (int *) *t; sp = t + 1; pc = (int *) pc[1]; NEXT;
+
+    OP(ROR) bp[pc[0]] = bp[pc[1]] | bp[pc[2]]; RNEXT;
+    OP(RXOR) bp[pc[0]] = bp[pc[1]] ^ bp[pc[2]]; RNEXT;
+    OP(RAND) bp[pc[0]] = bp[pc[1]] & bp[pc[2]]; RNEXT;
+    OP(REQ) bp[pc[0]] = bp[pc[1]] == bp[pc[2]]; RNEXT;
+    OP(RNE) bp[pc[0]] = bp[pc[1]] != bp[pc[2]]; RNEXT;
+    OP(RLT) bp[pc[0]] = bp[pc[1]] < bp[pc[2]]; RNEXT;
+    OP(RGT) bp[pc[0]] = bp[pc[1]] > bp[pc[2]]; RNEXT;
+    OP(RLE) bp[pc[0]] = bp[pc[1]] <= bp[pc[2]]; RNEXT;
+    OP(RGE) bp[pc[0]] = bp[pc[1]] >= bp[pc[2]]; RNEXT;
+    OP(RSHL) bp[pc[0]] = bp[pc[1]] << bp[pc[2]]; RNEXT;
+    OP(RSHR) bp[pc[0]] = bp[pc[1]] >> bp[pc[2]]; RNEXT;
+    OP(RADD) bp[pc[0]] = bp[pc[1]] + bp[pc[2]]; RNEXT;
+    OP(RSUB) bp[pc[0]] = bp[pc[1]] - bp[pc[2]]; RNEXT;
+    OP(RMUL) bp[pc[0]] = bp[pc[1]] * bp[pc[2]]; RNEXT;
+    OP(RDIV) bp[pc[0]] = bp[pc[1]] / bp[pc[2]]; RNEXT;
+    OP(RMOD) bp[pc[0]] = bp[pc[1]] % bp[pc[2]]; RNEXT;
+
+    OP(RORI) bp[pc[0]] = bp[pc[1]] | pc[2]; RNEXT;
+    OP(RXORI) bp[pc[0]] = bp[pc[1]] ^ pc[2]; RNEXT;
+    OP(RANDI) bp[pc[0]] = bp[pc[1]] & pc[2]; RNEXT;
+    OP(REQI) bp[pc[0]] = bp[pc[1]] == pc[2]; RNEXT;
+    OP(RNEI) bp[pc[0]] = bp[pc[1]] != pc[2]; RNEXT;
+    OP(RLTI) bp[pc[0]] = bp[pc[1]] < pc[2]; RNEXT;
+    OP(RGTI) bp[pc[0]] = bp[pc[1]] > pc[2]; RNEXT;
+    OP(RLEI) bp[pc[0]] = bp[pc[1]] <= pc[2]; RNEXT;
+    OP(RGEI) bp[pc[0]] = bp[pc[1]] >= pc[2]; RNEXT;
+    OP(RSHLI) bp[pc[0]] = bp[pc[1]] << pc[2]; RNEXT;
+    OP(RSHRI) bp[pc[0]] = bp[pc[1]] >> pc[2]; RNEXT;
+    OP(RADDI) bp[pc[0]] = bp[pc[1]] + pc[2]; RNEXT;
+    OP(RSUBI) bp[pc[0]] = bp[pc[1]] - pc[2]; RNEXT;
+    OP(RMULI) bp[pc[0]] = bp[pc[1]] * pc[2]; RNEXT;
+    OP(RDIVI) bp[pc[0]] = bp[pc[1]] / pc[2]; RNEXT;
+    OP(RMODI) bp[pc[0]] = bp[pc[1]] % pc[2]; RNEXT;
+
+    // system function call, the arguments end at bp + x like they would
+    // end at sp on the stack machine
+    OP(ROPEN) t = bp + pc[1]; bp[pc[0]] = open((char *) t[1], *t); RNEXT;
+    OP(RREAD) t = bp + pc[1]; bp[pc[0]] = read(t[2], (char *) t[1], *t); RNEXT;
+    OP(RCLOS) t = bp + pc[1]; bp[pc[0]] = close(*t); RNEXT;
+    OP(RWRIT)
+        t = bp + pc[1];
+        bp[pc[0]] = owrite(t[2], (char *) t[1], *t);
+        RNEXT;
+    OP(RPRTF)
+        t = bp + pc[1] + pc[2];
+        bp[pc[0]] = oprintf((char *) t[-1], t[-2], t[-3], t[-4], t[-5], t[-6]);
+        RNEXT;
+    OP(RMALC) t = bp + pc[1]; bp[pc[0]] = (int) vmalloc(*t); RNEXT;
+    OP(RFREE) t = bp + pc[1]; vfree((char *) *t); RNEXT;
+    OP(RMSET)
+        t = bp + pc[1];
+        bp[pc[0]] = (int) memset((char *) t[2], t[1], *t);
+        RNEXT;
+    OP(RMCMP)
+        t = bp + pc[1];
+        bp[pc[0]] = memcmp((char *) t[2], (char *) t[1], *t);
+        RNEXT;
+    OP(REXIT)
+        t = bp + pc[1];
+        oflush();
+        if (!quiet) {
+            printf("exit(%ld) cycle = %ld\n", *t, cycle);
+        }
+        ncycle = cycle;
+        return *t;
+    OP(RHALT)
+        oflush();
+        if (!quiet) {
+            printf("exit(%ld) cycle = %ld\n", a, cycle);
+        }
+        ncycle = cycle;
+        return a;
+    // clang-format on
+#ifndef __GNUC__
+    default:
+        printf("unknown instruction = %ld, cycle = %ld\n", pc[-1], cycle);
+        return -1;
+        }
+        ++cycle;
+    }
+#endif
+}
+
+// emit one byte, a 32-bit and a 64-bit little endian value of jit code
+void jb(int c)
+{
+    *jc++ = c;
+}
+
+void jd(int v)
+{
+    jb(v);
+    jb(v >> 8);
+    jb(v >> 16);
+    jb(v >> 24);
+}
+
+void jq(int v)
+{
+    jd(v);
+    jd(v >> 16 >> 16);
+}
+
+// load argument register n (rdi, rsi, rdx, rcx, r8, r9) from [rbx + off]
+void jarg(int n, int off)
+{
+    jb(n < 4 ? 0x48 : 0x4c);
+    jb(0x8b);
+    jb(0x83 | (n < 4 ? "\7\6\2\1"[n] : n - 4) << 3);
+    jd(off);
+}
+
+// call into libc: rbx keeps the VM sp, rsp is realigned to 16 bytes
+void jcall(char *f)
+{
+    jb(0x49), jb(0xbb), jq((int) f);  // mov r11, f
+    jb(0x31), jb(0xc0);               // xor eax, eax
+    jb(0x41), jb(0xff), jb(0xd3);     // call r11
+    jb(0x48), jb(0x89), jb(0xdc);     // mov rsp, rbx
+}
+
+void jsys()
+{
+    jb(0x48), jb(0x89), jb(0xe3);  // mov rbx, rsp
+    jb(0x48), jb(0x83), jb(0xe4), jb(0xf0);  // and rsp, -16
+}
+
+// x86-64 template jit: a lives in rax, sp in rsp, bp in rbp and the data
+// segment base in r13, so VM frames are laid out exactly like native ones
+// and JSR/LEV become call/ret. Every instruction of the text segment is
+// translated once, branch targets are patched after the whole segment has
+// been emitted.
+int jit(int *pc, int *sp)
+{
+    int i, k, n, na, sz, *t, *map, *fix, *f;
+    char *code, *halt;
+
+#if !defined(__x86_64__)
+    printf("jit needs an x86-64 host\n");
+    return -1;
+#endif
+    if (sizeof(char *) != 8) {
+        printf("jit needs a 64-bit word\n");
+        return -1;
+    }
+
+    // n instructions at most, none longer than 64 bytes, and the stubs
+    n = e - text + 1;
+    sz = n * 64 + 4096;
+    if ((code = mmap(0, sz, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        printf("could not mmap(%ld) jit code area\n", sz);
+        return -1;
+    }
+    if (!(map = malloc(n * sizeof(int))) ||
+        !(f = fix = malloc(n * sizeof(int)))) {
+        printf("could not malloc(%ld) jit map\n", n * sizeof(int));
+        return -1;
+    }
+    jc = code;
+
+    // entry: save host registers, switch to the VM stack and jump to main
+    jb(0x53), jb(0x55);                // push rbx; push rbp
+    jb(0x41), jb(0x54), jb(0x41), jb(0x55);  // push r12; push r13
+    jb(0x41), jb(0x56), jb(0x41), jb(0x57);  // push r14; push r15
+    jb(0x49), jb(0x89), jb(0xe7);      // mov r15, rsp
+    jb(0x49), jb(0x89), jb(0xd5);      // mov r13, rdx
+    jb(0x48), jb(0x89), jb(0xfc);      // mov rsp, rdi
+    jb(0x48), jb(0x89), jb(0xe5);      // mov rbp, rsp
+    jb(0x31), jb(0xc0);                // xor eax, eax
+    jb(0xff), jb(0xe6);                // jmp rsi
+
+    // exit: return rax to the host, main() returns here as well
+    halt = jc;
+    jb(0x4c), jb(0x89), jb(0xfc);      // mov rsp, r15
+    jb(0x41), jb(0x5f), jb(0x41), jb(0x5e);  // pop r15; pop r14
+    jb(0x41), jb(0x5d), jb(0x41), jb(0x5c);  // pop r13; pop r12
+    jb(0x5d), jb(0x5b), jb(0xc3);      // pop rbp; pop rbx; ret
+
+    t = text + 1;
+    while (t <= e) {
+        map[t - text] = jc - code;
+        i = *t++;
+        if (sbuf && i >= OPEN && i < EXIT) {
+            // -F: where the host is called from, for SIGPROF
+            jb(0x49), jb(0xbb), jq((int) shost);  // mov r11, shost
+            jb(0x49), jb(0x89), jb(0x2b);          // mov [r11], rbp
+            jb(0x49), jb(0xc7), jb(0x43), jb(0x08), jd(t - 1 - text);
+        }
+        if (i == LEA) {
+            jb(0x48), jb(0x8d), jb(0x85), jd(*t++ * sizeof(int));
+        } else if (i == IMM) {
+            if (*t >= -0x7fffffff - 1 && *t <= 0x7fffffff) {
+                jb(0x48), jb(0xc7), jb(0xc0), jd(*t++);
+            } else {
+                jb(0x48), jb(0xb8), jq(*t++);
+            }
+        } else if (i == JMP || i == JSR || i == TSR || i == BZ || i == BNZ) {
+            if (i == BZ || i == BNZ) {
+                jb(0x48), jb(0x85), jb(0xc0);  // test rax, rax
+                jb(0x0f), jb(i == BZ ? 0x84 : 0x85);
+            } else {
+                if (i == TSR) {
+                    jb(0x48), jb(0x8d), jb(0x65), jb(0x08);  // lea rsp, [rbp + 8]
+                    jb(0x48), jb(0x8b), jb(0x6d), jb(0x00);  // mov rbp, [rbp]
+                }
+                jb(i == JSR ? 0xe8 : 0xe9);
+            }
+            *f++ = jc - code;
+            *f++ = (int *) *t++ - text;
+            jd(0);
+        } else if (i >= BEQ && i <= BGE) {
+            jb(0x59);                      // pop rcx
+            jb(0x48), jb(0x39), jb(0xc1);  // cmp rcx, rax
+            jb(0x0f);
+            jb(i == BEQ   ? 0x84
+               : i == BNE ? 0x85
+               : i == BLT ? 0x8c
+               : i == BGT ? 0x8f
+               : i == BLE ? 0x8e
+                          : 0x8d);         // jcc rel32
+            *f++ = jc - code;
+            *f++ = (int *) *t++ - text;
+            jd(0);
+        } else if (i == ENT) {
+            jb(0x55);                      // push rbp
+            jb(0x48), jb(0x89), jb(0xe5);  // mov rbp, rsp
+            jb(0x48), jb(0x81), jb(0xec), jd(*t++ * sizeof(int));
+        } else if (i == ADJ) {
+            jb(0x48), jb(0x81), jb(0xc4), jd(*t++ * sizeof(int));
+        } else if (i == TAIL) {
+            k = *t++;
+            while (k--) {
+                jb(0x48), jb(0x8b), jb(0x8c), jb(0x24), jd(k * 8);  // mov rcx, [rsp + 8k]
+                jb(0x48), jb(0x89), jb(0x8d), jd(16 + k * 8);  // mov [rbp + 16 + 8k], rcx
+            }
+        } else if (i == ADDI) {
+            jb(0x48), jb(0x05), jd(*t++);  // add rax, imm32
+        } else if (i == MULI) {
+            jb(0x48), jb(0x69), jb(0xc0), jd(*t++);  // imul rax, rax, imm32
+        } else if (i == SHLI) {
+            jb(0x48), jb(0xc1), jb(0xe0), jb(*t++);  // shl rax, imm8
+        } else if (i == LLI) {
+            jb(0x48), jb(0x8b), jb(0x85), jd(*t++ * sizeof(int));
+        } else if (i == LLC) {
+            jb(0x48), jb(0x0f), jb(0xbe), jb(0x85), jd(*t++ * sizeof(int));
+        } else if (i == ADDP) {
+            jb(0x59);                                // pop rcx
+            jb(0x48), jb(0xc1), jb(0xe0), jb(*t++);  // shl rax, imm8
+            jb(0x48), jb(0x01), jb(0xc8);            // add rax, rcx
+        } else if (i == LEAG) {
+            jb(0x49), jb(0x8d), jb(0x85), jd(*t++);  // lea rax, [r13 + off]
+        } else if (i == LEV) {
+            jb(0x48), jb(0x89), jb(0xec);  // mov rsp, rbp
+            jb(0x5d), jb(0xc3);            // pop rbp; ret
+        } else if (i == LI) {
+            jb(0x48), jb(0x8b), jb(0x00);  // mov rax, [rax]
+        } else if (i == LC) {
+            jb(0x48), jb(0x0f), jb(0xbe), jb(0x00);  // movsx rax, byte [rax]
+        } else if (i == SI) {
+            jb(0x59);                      // pop rcx
+            jb(0x48), jb(0x89), jb(0x01);  // mov [rcx], rax
+        } else if (i == SC) {
+            jb(0x59);                      // pop rcx
+            jb(0x88), jb(0x01);            // mov [rcx], al
+            jb(0x48), jb(0x0f), jb(0xbe), jb(0xc0);  // movsx rax, al
+        } else if (i == PSH) {
+            jb(0x50);                      // push rax
+        } else if (i >= OR && i <= MOD) {
+            jb(0x59);                      // pop rcx
+            if (i == OR) {
+                jb(0x48), jb(0x09), jb(0xc8);
+            } else if (i == XOR) {
+                jb(0x48), jb(0x31), jb(0xc8);
+            } else if (i == AND) {
+                jb(0x48), jb(0x21), jb(0xc8);
+            } else if (i == ADD) {
+                jb(0x48), jb(0x01), jb(0xc8);
+            } else if (i == SUB) {
+                jb(0x48), jb(0x29), jb(0xc1);  // sub rcx, rax
+                jb(0x48), jb(0x89), jb(0xc8);  // mov rax, rcx
+            } else if (i == MUL) {
+                jb(0x48), jb(0x0f), jb(0xaf), jb(0xc1);
+            } else if (i == DIV || i == MOD) {
+                jb(0x48), jb(0x91);            // xchg rax, rcx
+                jb(0x48), jb(0x99);            // cqo
+                jb(0x48), jb(0xf7), jb(0xf9);  // idiv rcx
+                if (i == MOD) {
+                    jb(0x48), jb(0x89), jb(0xd0);  // mov rax, rdx
+                }
+            } else if (i == SHL || i == SHR) {
+                jb(0x48), jb(0x91);            // xchg rax, rcx
+                jb(0x48), jb(0xd3), jb(i == SHL ? 0xe0 : 0xf8);
+            } else {
+                jb(0x48), jb(0x39), jb(0xc1);  // cmp rcx, rax
+                jb(0x0f);
+                jb(i == EQ   ? 0x94
+                   : i == NE ? 0x95
+                   : i == LT ? 0x9c
+                   : i == GT ? 0x9f
+                   : i == LE ? 0x9e
+                             : 0x9d);
+                jb(0xc0);                      // setcc al
+                jb(0x0f), jb(0xb6), jb(0xc0);  // movzx eax, al
+            }
+        } else if (i == OPEN) {
+            jsys(), jarg(0, 8), jarg(1, 0), jcall((char *) open);
+            jb(0x48), jb(0x63), jb(0xc0);      // movsxd rax, eax
+        } else if (i == READ) {
+            jsys(), jarg(0, 16), jarg(1, 8), jarg(2, 0);
+            jcall((char *) read);
+        } else if (i == CLOS) {
+            jsys(), jarg(0, 0), jcall((char *) close);
+            jb(0x48), jb(0x63), jb(0xc0);
+        } else if (i == WRIT) {
+            jsys(), jarg(0, 16), jarg(1, 8), jarg(2, 0);
+            jcall((char *) owrite);
+        } else if (i == PRTF) {
+            na = *t == ADJ ? t[1] : 0;
+            jsys();
+            i = 0;
+            while (i < 6) {
+                jarg(i, (na - 1 - i) * sizeof(int));
+                ++i;
+            }
+            jcall((char *) oprintf);
+        } else if (i == MALC) {
+            jsys(), jarg(0, 0), jcall((char *) vmalloc);
+        } else if (i == FREE) {
+            jb(0x49), jb(0x89), jb(0xc4);      // mov r12, rax
+            jsys(), jarg(0, 0), jcall((char *) vfree);
+            jb(0x4c), jb(0x89), jb(0xe0);      // mov rax, r12
+        } else if (i == MSET) {
+            jsys(), jarg(0, 16), jarg(1, 8), jarg(2, 0);
+            jcall((char *) memset);
+        } else if (i == MCMP) {
+            jsys(), jarg(0, 16), jarg(1, 8), jarg(2, 0);
+            jcall((char *) memcmp);
+            jb(0x48), jb(0x63), jb(0xc0);
+        } else if (i == EXIT) {
+            jb(0x48), jb(0x8b), jb(0x04), jb(0x24);  // mov rax, [rsp]
+            jb(0xe9), jd(halt - jc - 4);
+        } else {
+            printf("jit: unknown instruction = %ld\n", i);
+            return -1;
+        }
+    }
+
+    // patch branch targets now that every instruction has an address
+    t = fix;
+    while (t < f) {
+        jc = code + *t;
+        jd(map[t[1]] - *t - 4);
+        t = t + 2;
+    }
+    if (mprotect(code, sz, PROT_READ | PROT_EXEC) < 0) {
+        printf("could not mprotect(%ld) jit code area\n", sz);
+        munmap(code, sz);
+        free(map);
+        free(fix);
+        return -1;
+    }
+    xlo = code;
+    xhi = code + sz;
+    xmap = map;
+    xunit = 1;
+
+    // main() returns into the exit stub
+    *sp = (int) halt;
+    i = ((int (*)(int *, char *, char *)) code)(sp, code + map[pc - text],
+                                                 dbase);
+    oflush();
+    if (!quiet) {
+        printf("exit(%ld)\n", i);
+    }
+    sreport();
+    munmap(code, sz);
+    free(map);
+    free(fix);
+    return i;
+}
+
+// read a whole file into an arena of its own followed by a '\0', and
+// store its size in n
+char *source(char *file, int *n)
+{
+    int fd, sz, i, k;
+    char *s;
+
+    if ((fd = open(file, 0)) < 0) {
+        printf("could not open(%s)\n", file);
+        return 0;
+    }
+    if ((sz = lseek(fd, 0, SEEK_END)) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+        printf("could not lseek(%s)\n", file);
+        return 0;
+    }
+    s = arena(sz + 1, "source");
+    i = 0;
+    while (i < sz && (k = read(fd, s + i, sz - i)) > 0) {
+        i = i + k;
+    }
+    if (i <= 0) {
+        printf("read() returned %ld\n", i);
+        return 0;
+    }
+    s[i] = '\0';
+    close(fd);
+    *n = i;
+    return s;
+}
+
+// symbol table entries wanted for n identifiers
+int symfor(int n)
+{
+    int k;
+
+    k = 16 * 1024;
+    while (k < n && k < 16 * 1024 * 1024) {
+        k = k * 2;
+    }
+    return k;
+}
+
+// -R: clear what the last program used of this thread's segments and
+// symbol table, so that the next one, of about n identifiers, compiles
+// into them without faulting in fresh pages. Fails if there are none yet
+// or the symbol table is too small.
+int recycle(int n)
+{
+    if (!sym || symsz < symfor(n)) {
+        return 0;
+    }
+    memset(sym, 0, nsym * Idsz * sizeof(int));
+    memset(hix, 0, hsz * 2 * sizeof(int));
+    memset(dbase, 0, data - dbase);
+    nsym = 0;
+    sc = scope;
+    le = e = tlast = text;
+    data = dbase;
+    return 1;
+}
+
+// give this thread fresh segments and a symbol table for about n
+// identifiers. The hash index grows with the identifiers actually seen.
+void segments(int n)
+{
+    symsz = symfor(n);
+    nsym = 0;
+    sym = (int *) arena(symsz * Idsz * sizeof(int), "symbol");
+    rehash(1024);
+    sc = scope = (int *) arena(symsz * sizeof(int), "scope");
+    text = le = e = tlast = (int *) arena(64 * 1024 * 1024, "text");
+    tend = text + 64 * 1024 * 1024 / sizeof(int);
+    tline = (int *) arena(64 * 1024 * 1024, "line");
+    dbase = data = arena(64 * 1024 * 1024, "data");
+    dend = dbase + 64 * 1024 * 1024;
+}
+
+// enter the keywords and the library into the symbol table and return the
+// entry of main
+int *keywords()
+{
+    int i;
+
+    p = "char else enum if int return sizeof while "
+        "open read close write printf malloc free memset memcmp exit void main";
+
+    // add keywords to symbol table
+    i = Char;
+    while (i <= While) {
+        next();
+        id[Tk] = i++;
+    }
+
+    // add library to symbol table
+    i = OPEN;
+    while (i <= EXIT) {
+        next();
+        id[Class] = Sys;
+        id[Type] = INT;
+        id[Val] = i++;
+    }
+
+    next();
+    id[Tk] = Char;  // handle void type
+    next();
+    return id;  // keep track of main
+}
+
+// fresh segments for about n identifiers, see keywords()
+int *compinit(int n)
+{
+    segments(n);
+    return keywords();
+}
+
+// compiler thread: compile units until there are none left
+void *worker(void *arg)
+{
+    int *u, n;
+    char *s;
+
+    while (1) {
+        pthread_mutex_lock(&ulock);
+        u = ujob < nunit ? units + ujob++ * Usz : 0;
+        pthread_mutex_unlock(&ulock);
+        if (!u) {
+            return 0;
+        }
+        if (!(s = source((char *) u[Ufile], &n))) {
+            fail();
+        }
+        compinit(n / 4);
+        lp = p = s;
+        prog();
+        u[Utext] = (int) text;
+        u[Ue] = (int) e;
+        u[Udbase] = (int) dbase;
+        u[Udata] = (int) data;
+        u[Usym] = (int) sym;
+        u[Unsym] = nsym;
+        u[Uline] = line - 1;
+        u[Utline] = (int) tline;
+    }
+}
+
+// the function a call to the symbol entry d refers to, looked up by name
+// in this thread's symbol table
+int *callee(int *d)
+{
+    char *s;
+
+    s = (char *) d[Name];
+    p = s;
+    next();
+    if (id[Class] != Fun) {
+        printf("undefined function %.*s\n", (signed) (scan(s, Sid, 0) - s),
+               s);
+        fail();
+    }
+    return (int *) id[Val];
+}
+
+// point the calls parsed before their function at it
+void resolve()
+{
+    int *r, *d, i;
+
+    r = text + 1;
+    while (r <= e) {
+        i = *r++;
+        if ((i == JSR || i == TSR) && ((int *) *r < text || (int *) *r > e)) {
+            // the entry is this file's own, defined by now if ever
+            d = (int *) *r;
+            *r = d[Class] == Fun ? d[Val] : (int) callee(d);
+        }
+        if (i < LEV) {
+            ++r;
+        }
+    }
+}
+
+// link the units the workers compiled into this thread's segments and
+// return the entry of main. Functions and globals are entered by name into
+// a fresh symbol table, globals of the same name are merged like C's
+// common symbols, and then text and data are concatenated, relocating
+// branches, calls and data offsets on the way.
+int *linkall()
+{
+    int *u, *d, *m, *g, *r, *idmain, n, i, toff, doff;
+    char *s;
+
+    n = 0;
+    u = units;
+    while (u < units + nunit * Usz) {
+        n = n + u[Unsym];
+        u = u + Usz;
+    }
+    idmain = compinit(n);
+
+    // place every unit and define what it defines
+    toff = doff = 0;
+    u = units;
+    while (u < units + nunit * Usz) {
+        u[Utoff] = toff;
+        u[Udoff] = doff;
+        n = (u[Udata] - u[Udbase]) / sizeof(int) + 1;
+        if (!(g = malloc(n * sizeof(int)))) {
+            printf("could not malloc(%ld) link map\n", n * sizeof(int));
+            fail();
+        }
+        memset(g, 0, n * sizeof(int));
+        u[Umap] = (int) g;
+        d = (int *) u[Usym];
+        while (d < (int *) u[Usym] + u[Unsym] * Idsz) {
+            if (d[Class] == Fun || d[Class] == Glo) {
+                s = (char *) d[Name];
+                p = s;
+                next();
+                m = id;
+                if (m[Class] && (m[Class] != Glo || d[Class] != Glo)) {
+                    printf("%s: duplicate definition of %.*s\n",
+                           (char *) u[Ufile],
+                           (signed) (scan(s, Sid, 0) - s), s);
+                    fail();
+                }
+                if (d[Class] == Fun) {
+                    m[Val] = (int) (text + toff + ((int *) d[Val] -
+                                                   (int *) u[Utext]));
+                } else {
+                    if (!m[Class]) {
+                        m[Val] = doff + d[Val];
+                    }
+                    g[d[Val] / sizeof(int)] = m[Val] + 1;
+                }
+                m[Class] = d[Class];
+                m[Type] = d[Type];
+            }
+            d = d + Idsz;
+        }
+        toff = toff + ((int *) u[Ue] - (int *) u[Utext]);
+        doff = doff + u[Udata] - u[Udbase] + sizeof(int) - 1 & -sizeof(int);
+        u = u + Usz;
+    }
+    if (text + toff >= tend || dbase + doff > dend) {
+        printf("program too large to link\n");
+        fail();
+    }
+
+    // concatenate text and data
+    u = units;
+    while (u < units + nunit * Usz) {
+        g = (int *) u[Umap];
+        d = (int *) u[Utext];
+        r = d + 1;
+        while (r <= (int *) u[Ue]) {
+            i = *++e = *r++;
+            if (i == JMP || i == JSR || i == TSR || (i >= BZ && i <= BGE)) {
+                if ((int *) *r >= d && (int *) *r <= (int *) u[Ue]) {
+                    *++e = (int) (text + u[Utoff] + ((int *) *r - d));
+                } else {
+                    *++e = (int) callee((int *) *r);
+                }
+                ++r;
+            } else if (i == LEAG) {
+                *++e = *r % sizeof(int) || !g[*r / sizeof(int)]
+                           ? *r + u[Udoff]
+                           : g[*r / sizeof(int)] - 1;
+                ++r;
+            } else if (i < LEV) {
+                *++e = *r++;
+            }
+        }
+        memcpy(tline + u[Utoff] + 1, (int *) u[Utline] + 1,
+               ((int *) u[Ue] - d) * sizeof(int));
+        tlast = e;
+        memcpy(dbase + u[Udoff], (char *) u[Udbase], u[Udata] - u[Udbase]);
+        nline = nline + u[Uline];
+        free(g);
+        u = u + Usz;
+    }
+    data = dbase + doff;
+    return idmain;
+}
+
+// the text instruction whose code holds the return address w, which is
+// just past the code of the call, or 0 if w is not in the engine's code
+int *callsite(char *w)
+{
+    int *c, *t, o;
+
+    if (w <= xlo || w > xhi) {
+        return 0;
+    }
+    o = w - xlo - 1;
+    t = 0;
+    c = text + 1;
+    while (c <= e &&
+           (xmap ? xmap[c - text] * xunit : (c - text) * sizeof(int)) <= o) {
+        t = c;
+        c = c + (*c < LEV ? 2 : 1);
+    }
+    return t && *t == JSR ? t : 0;
+}
+
+// SIGSEGV: a fault in the guard page below the VM stack is the program
+// recursing too deep. The innermost return address on the stack names the
+// call that overflowed and the function it is in. Other faults are not
+// ours and go to whatever handled them before.
+struct sigaction oldsegv;
+
+void overflow(signed sig, siginfo_t *si, void *uc)
+{
+    int *w, *t, *f, n;
+    char *s, *a;
+
+    a = si->si_addr;
+    if (!vstk || a < vstk - 4096 || a >= vstk) {
+        if (oldsegv.sa_flags & SA_SIGINFO) {
+            oldsegv.sa_sigaction(sig, si, uc);
+        } else if (oldsegv.sa_handler != SIG_IGN &&
+                   oldsegv.sa_handler != SIG_DFL) {
+            oldsegv.sa_handler(sig);
+        } else {
+            signal(SIGSEGV, SIG_DFL);
+        }
+        return;
+    }
+    t = 0;
+    w = (int *) vstk;
+    while (w < (int *) vend && !(t = callsite((char *) *w))) {
+        ++w;
+    }
+    f = 0;
+    id = sym;
+    while (t && id < sym + nsym * Idsz) {
+        if (id[Class] == Fun && (int *) id[Val] <= t &&
+            (!f || id[Val] > f[Val])) {
+            f = id;
+        }
+        id = id + Idsz;
+    }
+    vstk = 0;
+    oflush();
+    if (f) {
+        s = (char *) f[Name];
+        n = scan(s, Sid, 0) - s;
+        printf("stack overflow at pc %ld in %.*s()\n", t - text, (signed) n,
+               s);
+    } else if (t) {
+        printf("stack overflow at pc %ld\n", t - text);
+    } else {
+        printf("stack overflow\n");
+    }
+    fail();
+}
+
+pthread_once_t segvonce = PTHREAD_ONCE_INIT;
+
+void segvinit()
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = overflow;
+    // SIGSEGV stays unblocked when fail() longjmps out of the handler
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &oldsegv);
+}
+
+// the SIGSEGV handler, once, and the signal stack it runs on, once per
+// thread that runs programs
+void vminit()
+{
+    stack_t ss;
+
+    pthread_once(&segvonce, segvinit);
+    if (!altstk) {
+        altstk = arena(Alt, "signal stack");
+        ss.ss_sp = altstk;
+        ss.ss_size = Alt;
+        ss.ss_flags = 0;
+        sigaltstack(&ss, 0);
+    }
+}
+
+// the sz byte stack at stk set up for main(): argc and argv, and a return
+// address to the PSH; EXIT at its top. The stack pointer.
+int *vframe(char *stk, int sz, int argc, char **argv)
+{
+    int *sp, *t;
+
+    sp = (int *) (stk + sz);
+    *--sp = EXIT;  // call exit if main returns
+    *--sp = PSH;
+    t = sp;
+    *--sp = argc;
+    *--sp = (int) argv;
+    *--sp = (int) t;
+    return sp;
+}
+
+// run main() at pc with argc and argv on the sz byte stack at stk, on the
+// engine how, see engine(). The stack comes from arena(), so its guard
+// page turns an overflow into a SIGSEGV for overflow() at no cost to the
+// engines.
+int execute(int *pc, char *stk, int sz, int argc, char **argv, int how)
+{
+    int *sp, i;
+
+    vminit();
+    vstk = stk;
+    vend = stk + sz;
+    xlo = (char *) text;
+    xhi = (char *) (e + 1);
+    xmap = 0;
+    sp = vframe(stk, sz, argc, argv);
+
+    obuf = malloc(Obuf);
+    olen = 0;
+    hinit();
+    if (how == 'p') {
+        pinit(pc, sz);
+        i = run(pc, sp);
+        pfree();
+    } else if (how == 'j') {
+        i = jit(pc, sp);
+    } else if (how == 't') {
+        i = run(pc, sp);
+    } else if (how == 'r') {
+        i = rrun(rtrans(pc), sp);
+        release((char *) rtext, (rend - rtext) * sizeof(int) + 4096);
+        free(rmap);
+        rmap = 0;
+    } else {
+        i = interp(pc, sp);
+    }
+    sreport();
+    vstk = xlo = 0;
+    hrelease();
+    oflush();
+    free(obuf);
+    obuf = 0;
+    return i;
+}
+
+// after fail() left execute() halfway through engine how, free the code
+// it had translated the program into and the program's heap
+void abandon(int how)
+{
+    if (xlo && xlo != (char *) text) {
+        if (how == 't' || how == 'p') {
+            free(xlo);
+        } else if (how == 'r') {
+            release((char *) rtext, (rend - rtext) * sizeof(int) + 4096);
+            free(rmap);
+            rmap = 0;
+        } else if (how == 'j') {
+            munmap(xlo, xhi - xlo);
+            free(xmap);
+        }
+    }
+    if (how == 'p') {
+        pfree();
+    }
+    vstk = xlo = 0;
+    hrelease();
+}
+
+// the engine the flags pick for execute(): 'p'rofiling, 'j'it, 't'hreaded,
+// 'r'egister tier, or 0 for the reference interpreter, which -d needs.
+// -F samples on the threaded interpreter unless it is to be native code.
+int engine()
+{
+    if (debug) {
+        return 0;
+    }
+    return profile ? 'p' : jitted ? 'j' : threaded || pfold ? 't'
+           : regtier ? 'r' : 0;
+}
+
+// -R: runner thread. Compile and run programs until there are none left,
+// each on the thread's own segments and stack, which are cleared and
+// reused from one program to the next. An error in a program ends that
+// program only.
+void *runner(void *arg)
+{
+    int *u, *idmain, *pc, n;
+    char *s, *stk;
+    jmp_buf env;
+
+    stk = arena(stksz, "stack");
+    hcap = heapsz;
+    while (1) {
+        pthread_mutex_lock(&ulock);
+        u = ujob < nunit ? units + ujob++ * Usz : 0;
+        pthread_mutex_unlock(&ulock);
+        if (!u) {
+            return 0;
+        }
+        u[Uexit] = -1;
+        if (!(s = source((char *) u[Ufile], &n))) {
+            continue;
+        }
+        onfail = &env;
+        if (!setjmp(env)) {
+            if (!recycle(n / 4)) {
+                segments(n / 4);
+            }
+            idmain = keywords();
+            lp = p = s;
+            prog();
+            resolve();
+            if (opt >= 1) {
+                peep();
+            }
+            if (!(pc = (int *) idmain[Val])) {
+                printf("%s: main() not defined\n", (char *) u[Ufile]);
+            } else {
+                // argv is the file name, ended by the unused Utext
+                u[Uexit] = execute(pc, stk, stksz, 1, (char **) u + Ufile,
+                                   engine());
+            }
+        } else {
+            abandon(engine());
+        }
+        onfail = 0;
+        release(s, n + 1);
+    }
+}
+
+// libbfcc: a compiled program, Psz words. The text segment, read only
+// once compiled, and its end, the entry of main, a memfd holding the
+// initial data segment and its size in whole pages, and the symbol table
+// and the source its names point into, kept for -p style naming.
+enum { Ptext, Pe, Pentry, Pfd, Pdsz, Psym, Pnsym, Psymsz, Psrc, Psrcsz, Psz };
+
+pthread_once_t lexonce = PTHREAD_ONCE_INIT;
+
+// libbfcc: see bfcc.h. The peephole pass always runs.
+int *bfcc_compile(char *source, int n)
+{
+    int *volatile g;  // volatile to survive fail()'s longjmp
+    int *idmain, k;
+    char *s;
+    jmp_buf env;
+
+    pthread_once(&lexonce, (void (*)(void)) lexinit);
+    s = arena(n + 1, "source");
+    memcpy(s, source, n);
+    s[n] = '\0';
+    text = sym = scope = tline = 0;
+    dbase = 0;
+    g = 0;
+    onfail = &env;
+    if (!setjmp(env)) {
+        idmain = compinit(n / 4);
+        lp = p = s;
+        prog();
+        resolve();
+        peep();
+        if (!idmain[Val]) {
+            printf("main() not defined\n");
+            fail();
+        }
+        if (!(g = malloc(Psz * sizeof(int)))) {
+            printf("could not malloc(%ld) program\n", Psz * sizeof(int));
+            fail();
+        }
+        g[Pfd] = -1;
+        // the data segment goes to a file that every run maps privately
+        k = ((data - dbase) | 1) + 4095 & -4096;
+        if ((g[Pfd] = memfd_create("bfcc data", MFD_CLOEXEC)) < 0 ||
+            write(g[Pfd], dbase, data - dbase) != data - dbase ||
+            ftruncate(g[Pfd], k) < 0) {
+            printf("could not save the data segment\n");
+            fail();
+        }
+        mprotect(text, 64 * 1024 * 1024, PROT_READ);
+        g[Ptext] = (int) text;
+        g[Pe] = (int) e;
+        g[Pentry] = idmain[Val];
+        g[Pdsz] = k;
+        g[Psym] = (int) sym;
+        g[Pnsym] = nsym;
+        g[Psymsz] = symsz;
+        g[Psrc] = (int) s;
+        g[Psrcsz] = n + 1;
+    } else if (g) {
+        if (g[Pfd] >= 0) {
+            close(g[Pfd]);
+        }
+        free(g);
+        g = 0;
+    }
+    onfail = 0;
+
+    if (dbase) {
+        release(dbase, 64 * 1024 * 1024);
+    }
+    if (scope) {
+        release((char *) scope, symsz * sizeof(int));
+    }
+    if (tline) {
+        release((char *) tline, 64 * 1024 * 1024);
+    }
+    free(hix);
+    hix = 0;
+    if (!g) {
+        if (text) {
+            release((char *) text, 64 * 1024 * 1024);
+        }
+        if (sym) {
+            release((char *) sym, symsz * Idsz * sizeof(int));
+        }
+        release(s, n + 1);
+    }
+    return g;
+}
+
+// libbfcc: see bfcc.h
+int bfcc_run(int *g, int argc, char **argv, int *limits)
+{
+    int sz, how;
+    volatile int i;     // volatile to survive fail()'s longjmp
+    char *volatile stk;
+    jmp_buf env;
+
+    sz = limits && limits[BFCC_STACK] ? limits[BFCC_STACK] : 8 * 1024 * 1024;
+    how = limits ? limits[BFCC_ENGINE] : 0;
+    hcap = limits ? limits[BFCC_HEAP] : 0;
+    if (how != 't' && how != 'r' && how != 'j') {
+        how = 0;
+    }
+    text = (int *) g[Ptext];
+    e = (int *) g[Pe];
+    sym = (int *) g[Psym];
+    nsym = g[Pnsym];
+    // copy on write: pages stay shared with the program until written
+    dbase = mmap(0, g[Pdsz], PROT_READ | PROT_WRITE, MAP_PRIVATE, g[Pfd], 0);
+    if (dbase == MAP_FAILED) {
+        printf("could not mmap(%ld) data segment\n", g[Pdsz]);
+        return -1;
+    }
+    data = dend = dbase + g[Pdsz];
+    i = -1;
+    stk = 0;
+    quiet = 1;
+    onfail = &env;
+    if (!setjmp(env)) {
+        stk = arena(sz, "stack");
+        i = execute((int *) g[Pentry], stk, sz, argc, argv, how);
+    } else {
+        abandon(how);
+    }
+    onfail = 0;
+    quiet = 0;
+    if (stk) {
+        release(stk, sz);
+    }
+    munmap(dbase, g[Pdsz]);
+    return i;
+}
+
+// libbfcc: see bfcc.h
+void bfcc_free(int *g)
+{
+    close(g[Pfd]);
+    release((char *) g[Ptext], 64 * 1024 * 1024);
+    release((char *) g[Psym], g[Psymsz] * Idsz * sizeof(int));
+    release((char *) g[Psrc], g[Psrcsz]);
+    free(g);
+}
+
+// -T: a task that runs main() of program g with argc and argv on an sz
+// byte stack, with a heap of at most cap bytes, 0 for no limit, and a
+// copy-on-write view of g's data segment, like bfcc_run(). It is not on
+// any run queue yet. 0 if the data segment could not be mapped.
+int *spawn(int *g, int argc, char **argv, int sz, int cap)
+{
+    int *k;
+    char *d, *stk;
+
+    stk = arena(sz, "stack");
+    d = mmap(0, g[Pdsz], PROT_READ | PROT_WRITE, MAP_PRIVATE, g[Pfd], 0);
+    if (d == MAP_FAILED) {
+        printf("could not mmap(%ld) data segment\n", g[Pdsz]);
+        release(stk, sz);
+        return 0;
+    }
+    if (!(k = calloc(Tsz, sizeof(int)))) {
+        printf("could not malloc(%ld) task\n", Tsz * sizeof(int));
+        munmap(d, g[Pdsz]);
+        release(stk, sz);
+        return 0;
+    }
+    k[Tdbase] = (int) d;
+    k[Tstk] = (int) stk;
+    k[Tstksz] = sz;
+    k[Tsp] = (int) vframe((char *) k[Tstk], sz, argc, argv);
+    k[Tpc] = g[Pentry];
+    k[Tcap] = cap;
+    k[Tprog] = (int) g;
+    return k;
+}
+
+// -T: put task k at the tail of q's run queue, live is 1 for a new task
+void queue(int *q, int *k, int live)
+{
+    pthread_mutex_lock(&qlock);
+    k[Tnext] = 0;
+    if (q[Qtail]) {
+        ((int *) q[Qtail])[Tnext] = (int) k;
+    } else {
+        q[Qhead] = (int) k;
+    }
+    q[Qtail] = (int) k;
+    q[Qlive] = q[Qlive] + live;
+    pthread_cond_signal(&qcond);
+    pthread_mutex_unlock(&qlock);
+}
+
+// -T: run task k on this thread for n cycles, until its next call or
+// backward jump after that, with the thread's segments, stack and heap
+// switched to the task's and back. 1 if it yielded, 0 if it has ended,
+// with its exit status in *k[Texit], -1 after an error that fail() took
+// it out of.
+int resume(int *k, int n)
+{
+    int *g, i;
+    jmp_buf env, *up;
+
+    vminit();
+    g = (int *) k[Tprog];
+    text = (int *) g[Ptext];
+    e = (int *) g[Pe];
+    sym = (int *) g[Psym];
+    nsym = g[Pnsym];
+    dbase = (char *) k[Tdbase];
+    data = dend = dbase + g[Pdsz];
+    vstk = (char *) k[Tstk];
+    vend = vstk + k[Tstksz];
+    xlo = 0;
+    xmap = 0;
+    if (!obuf) {
+        obuf = malloc(Obuf);
+        olen = 0;
+    }
+    hswap(k + Theap);
+    hcap = k[Tcap];
+    k[Tslice] = n;
+    task = k;
+    up = onfail;
+    onfail = &env;
+    if (!setjmp(env)) {
+        i = run((int *) k[Tpc], (int *) k[Tsp]);
+    } else {
+        abandon('t');
+        k[Tcode] = 0;
+        i = -1;
+    }
+    onfail = up;
+    task = 0;
+    vstk = xlo = 0;
+    oflush();
+    hswap(k + Theap);
+    if (k[Tcode]) {
+        return 1;
+    }
+    if (k[Texit]) {
+        *(int *) k[Texit] = i;
+    }
+    return 0;
+}
+
+// -T: give back what a task that has ended held, and its program if it
+// owns it
+void reap(int *k)
+{
+    munmap((char *) k[Tdbase], ((int *) k[Tprog])[Pdsz]);
+    release((char *) k[Tstk], k[Tstksz]);
+    if (k[Town]) {
+        bfcc_free((int *) k[Tprog]);
+    }
+    free(k);
+}
+
+// -T: take the task at the head of q's run queue, run it for a slice and
+// put it back at the tail, unless it ended. With wait and an empty run
+// queue, wait for a task that runs on another thread to come back, or for
+// the last to end. 0 if there was no task to run.
+int step(int *q, int wait)
+{
+    int *k;
+
+    pthread_mutex_lock(&qlock);
+    while (!(k = (int *) q[Qhead]) && wait && q[Qlive]) {
+        pthread_cond_wait(&qcond, &qlock);
+    }
+    if (k && !(q[Qhead] = k[Tnext])) {
+        q[Qtail] = 0;
+    }
+    pthread_mutex_unlock(&qlock);
+    if (!k) {
+        return 0;
+    }
+    if (resume(k, q[Qslice])) {
+        queue(q, k, 0);
+        return 1;
+    }
+    reap(k);
+    pthread_mutex_lock(&qlock);
+    if (!--q[Qlive]) {
+        pthread_cond_broadcast(&qcond);
+    }
+    pthread_mutex_unlock(&qlock);
+    return 1;
+}
+
+// -R with -T: runner thread. Compile programs and start each as a task on
+// the scheduler in arg, with a slice of whichever task is next after each
+// one, then run the tasks until they have all ended, on this thread and
+// the other runners. Tasks always run on the threaded interpreter.
+void *tasker(void *arg)
+{
+    int *q, *u, *g, *k, n;
+    char *s;
+
+    q = arg;
+    while (1) {
+        pthread_mutex_lock(&ulock);
+        u = ujob < nunit ? units + ujob++ * Usz : 0;
+        pthread_mutex_unlock(&ulock);
+        if (!u) {
+            break;
+        }
+        u[Uexit] = -1;
+        if ((s = source((char *) u[Ufile], &n))) {
+            g = bfcc_compile(s, n);
+            release(s, n + 1);
+            // argv is the file name, ended by the unused Utext
+            if (g && !(k = spawn(g, 1, (char **) u + Ufile, stksz, heapsz))) {
+                bfcc_free(g);
+            } else if (g) {
+                k[Town] = 1;
+                k[Texit] = (int) (u + Uexit);
+                queue(q, k, 1);
+            }
+        }
+        step(q, 0);
+    }
+    while (step(q, 1)) {
+    }
+    free(obuf);
+    obuf = 0;
+    return 0;
+}
+
+// libbfcc: see bfcc.h
+int *bfcc_sched(int slice)
+{
+    int *q;
+
+    if (!(q = calloc(Qsz, sizeof(int)))) {
+        return 0;
+    }
+    q[Qslice] = slice > 0 ? slice : 10000;
+    return q;
+}
+
+// libbfcc: see bfcc.h
+int bfcc_spawn(int *q, int *g, int argc, char **argv, int *limits,
+               int *status)
+{
+    int *volatile k;  // volatile to survive fail()'s longjmp
+    jmp_buf env;
+
+    k = 0;
+    onfail = &env;
+    if (!setjmp(env)) {
+        k = spawn(g, argc, argv,
+                  limits && limits[BFCC_STACK] ? limits[BFCC_STACK]
+                                               : 8 * 1024 * 1024,
+                  limits ? limits[BFCC_HEAP] : 0);
+    }
+    onfail = 0;
+    if (!k) {
+        return -1;
+    }
+    k[Texit] = (int) status;
+    queue(q, k, 1);
+    return 0;
+}
+
+// libbfcc: see bfcc.h
+void bfcc_serve(int *q)
+{
+    quiet = 1;
+    while (step(q, 1)) {
+    }
+    quiet = 0;
+    free(obuf);
+    obuf = 0;
+}
+
+// libbfcc: see bfcc.h
+void bfcc_unsched(int *q)
+{
+    free(q);
+}
+
+// -S, -M: a size in bytes, or with a k, m or g suffix in KB, MB or GB
+int bytes(char *s)
+{
+    int n;
+
+    n = strtol(s, &s, 0);
+    return *s == 'k' ? n << 10 : *s == 'm' ? n << 20 : *s == 'g' ? n << 30 : n;
+}
+
+int bfcc(int argc, char **argv)
+{
+    int bt, *idmain, l[7];
+    char *out, *asmout, *cache, cfile[4096], *stk, *s;
+    pthread_t lth;
+
+    // vm registers
+    int *pc;  // 程序计数器
+
+    int i, *t, *q;
+    double t0;
+
+    tstart = now();
+
+    // 第一个参数是程序本身
+    --argc;
+    ++argv;
+
+    // -s -d -t -r -j -O[n] -L -R n -T slice -S stack -M heap -w image
+    // -A asm -C cachedir -v -p -P json -F folded
+    out = asmout = cache = 0;
+    stksz = 8 * 1024 * 1024;
+    while (argc > 0 && **argv == '-') {
+        if ((*argv)[1] == 's') {
+            src = 1;
+        } else if ((*argv)[1] == 'd') {
+            debug = 1;
+        } else if ((*argv)[1] == 't') {
+            threaded = 1;
+        } else if ((*argv)[1] == 'r') {
+            regtier = 1;
+        } else if ((*argv)[1] == 'j') {
+            jitted = 1;
+        } else if ((*argv)[1] == 'O') {
+            opt = (*argv)[2] ? (*argv)[2] - '0' : 1;
+        } else if ((*argv)[1] == 'L') {
+            piped = 1;
+        } else if ((*argv)[1] == 'R' && argc > 1) {
+            pool = atoi(*++argv);
+            --argc;
+        } else if ((*argv)[1] == 'T' && argc > 1) {
+            slice = atoi(*++argv);
+            --argc;
+        } else if ((*argv)[1] == 'S' && argc > 1) {
+            stksz = bytes(*++argv);
+            if (stksz < 4096) {
+                stksz = 4096;
+            }
+            --argc;
+        } else if ((*argv)[1] == 'M' && argc > 1) {
+            heapsz = bytes(*++argv);
+            --argc;
+        } else if ((*argv)[1] == 'w' && argc > 1) {
+            out = *++argv;
+            --argc;
+        } else if ((*argv)[1] == 'A' && argc > 1) {
+            asmout = *++argv;
+            --argc;
+        } else if ((*argv)[1] == 'C' && argc > 1) {
+            cache = *++argv;
+            --argc;
+        } else if ((*argv)[1] == 'v') {
+            verbose = 1;
+        } else if ((*argv)[1] == 'p') {
+            profile = 1;
+        } else if ((*argv)[1] == 'P' && argc > 1) {
+            profile = 1;
+            pjson = *++argv;
+            --argc;
+        } else if ((*argv)[1] == 'F' && argc > 1) {
+            pfold = *++argv;
+            --argc;
+        } else {
+            break;
+        }
+        --argc;
+        ++argv;
+    }
+
+    if (argc < 1) {
+        printf("usage: bfcc [-s] [-d] [-t] [-r] [-j] [-O[n]] [-L] [-S stack] "
+               "[-M heap] [-w image] [-A asm] [-C dir] [-v] [-p] [-P json] "
+               "[-F folded] file [arg ...]\n"
+               "       bfcc [option ...] file ... -- [arg ...]\n"
+               "       bfcc -R threads [-T slice] [option ...] file ...\n");
+        return -1;
+    }
+
+    // with "--" every argument before it is a translation unit, otherwise
+    // only the first one is and the rest go to the program
+    nunit = 1;
+    while (nunit < argc && strcmp(argv[nunit], "--")) {
+        ++nunit;
+    }
+    if (nunit == argc) {
+        nunit = 1;
+    }
+    lexinit();
+
+    // -R: every file is a program of its own, run on a pool of threads,
+    // with -T all at once as tasks that take turns on them
+    if (pool > 0) {
+        nunit = argc;
+        units = (int *) arena(nunit * Usz * sizeof(int), "unit");
+        t = (int *) arena(pool * sizeof(pthread_t), "runner");
+        i = 0;
+        while (i < nunit) {
+            units[i * Usz + Ufile] = (int) argv[i];
+            ++i;
+        }
+        q = slice > 0 ? bfcc_sched(slice) : 0;
+        i = 0;
+        while (i < pool) {
+            if (pthread_create((pthread_t *) t + i, 0, q ? tasker : runner,
+                               q)) {
+                printf("could not start a runner thread\n");
+                return -1;
+            }
+            ++i;
+        }
+        while (i > 0) {
+            pthread_join(((pthread_t *) t)[--i], 0);
+        }
+        if (q) {
+            bfcc_unsched(q);
+        }
+        // the status is the number of programs that did not exit with 0
+        bt = i = 0;
+        while (i < nunit) {
+            printf("%s: exit(%ld)\n", argv[i], units[i * Usz + Uexit]);
+            bt = bt + (units[i * Usz + Uexit] != 0);
+            ++i;
+        }
+        return bt;
+    }
+
+    stk = arena(stksz, "stack");
+
+    pc = 0;
+    if (nunit == 1) {
+        if (!(s = source(*argv, &i))) {
+            return -1;
+        }
+        idmain = compinit(i / 4);
+        lp = p = s;
+
+        // a precompiled image, or a cache hit for this source, skips parsing
+        if (i >= 4 && !memcmp(p, "BFCI", 4)) {
+            if (!(pc = load(*argv))) {
+                return -1;
+            }
+        } else if (cache && !src) {
+            sprintf(cfile, "%.4000s/%016llx.bfi", cache, hash(p, i));
+            pc = load(cfile);
+        }
+    }
+
+    if (!pc) {
+        // parse declarations
+        t0 = now();
+        if (nunit > 1) {
+            // -s prints each unit as it is parsed, so it takes one worker
+            units = (int *) arena(nunit * Usz * sizeof(int), "unit");
+            i = 0;
+            while (i < nunit) {
+                units[i * Usz + Ufile] = (int) argv[i];
+                ++i;
+            }
+            bt = src ? 1 : sysconf(_SC_NPROCESSORS_ONLN);
+            bt = bt < 1 ? 1 : bt > nunit ? nunit : bt;
+            t = (int *) arena(bt * sizeof(pthread_t), "worker");
+            i = 0;
+            while (i < bt) {
+                if (pthread_create((pthread_t *) t + i, 0, worker, 0)) {
+                    printf("could not start a compiler thread\n");
+                    return -1;
+                }
+                ++i;
+            }
+            while (i > 0) {
+                pthread_join(((pthread_t *) t)[--i], 0);
+            }
+            idmain = linkall();
+            argv[nunit] = *argv;
+            argv = argv + nunit;
+            argc = argc - nunit;
+        } else {
+            // -s interleaves source lines with the code emitted so far,
+            // which needs the lexer in step with the parser
+            if (piped && !src) {
+                lring = (int *) arena(Ring * 4 * sizeof(int), "token");
+                l[0] = (int) arena(64 * 1024 * 1024, "string");
+                l[1] = (int) p;
+                l[2] = (int) sym;
+                l[3] = symsz;
+                l[4] = nsym;
+                l[5] = (int) hix;
+                l[6] = hsz;
+                if (pthread_create(&lth, 0, lexer, l)) {
+                    printf("could not start the lexer thread\n");
+                    return -1;
+                }
+            }
+            prog();
+            if (lring) {
+                pthread_join(lth, 0);
+                nsym = l[4];
+                hix = (int *) l[5];
+                hsz = l[6];
+                // the ring is used up, next() lexes for itself again
+                lring = 0;
+            }
+            nline = line - 1;
+            resolve();
+        }
+        tparse = now() - t0;
+
+        if (opt >= 1) {
+            i = e - text;
+            bt = peep();
+            if (src) {
+                printf("peephole: %ld words, %ld instructions fused away\n",
+                       i - (e - text), bt);
+            }
+        }
+        lpack();
+
+        if (!(pc = (int *) idmain[Val])) {
+            printf("main() mot defined\n");
+            return -1;
+        }
+
+        if (src) {
+            if (regtier) {
+                rdump(rtrans(pc));
+            }
+            return 0;
+        }
+        if (cache && nunit == 1) {
+            save(cfile, pc);
+        }
+    }
+
+    if (out) {
+        return save(out, pc);
+    }
+    if (asmout) {
+        return native(asmout, pc);
+    }
+
+    // run...
+    t0 = now();
+    hcap = heapsz;
+    if (pfold) {
+        sstart(pc);
+    }
+    i = execute(pc, stk, stksz, argc, argv, engine());
+    trun = now() - t0;
+
+    if (verbose) {
+        report(stk);
+    }
+    return i;
+}
+
+#undef int
+#ifndef BFCC_LIB
+int main(int argc, char **argv)
+{
+    return bfcc(argc, argv);
+}
+#endif
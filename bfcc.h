@@ -0,0 +1,65 @@
+// libbfcc: compile a bfcc program once and run it many times, from as many
+// threads at once as needed. Build bfcc.c with -DBFCC_LIB, which leaves out
+// main(), keep only the bfcc_* symbols global and link with -pthread:
+//
+//     cc -O2 -pthread -DBFCC_LIB -c bfcc.c
+//     objcopy -w --keep-global-symbol='bfcc_*' bfcc.o libbfcc.o
+//
+//     long *p = bfcc_compile(src, strlen(src));
+//     long limits[BFCC_LIMITS] = { 1024 * 1024, 't' };
+//     long status = bfcc_run(p, argc, argv, limits);
+//     bfcc_free(p);
+//
+// or, for many runs at once on a few threads, as green threads:
+//
+//     long *s = bfcc_sched(0);
+//     bfcc_spawn(s, p, argc, argv, limits, &status);
+//     bfcc_serve(s);  // on every thread that is to run them
+//     bfcc_unsched(s);
+#ifndef BFCC_H
+#define BFCC_H
+
+// what bfcc_run() takes in its limits array. A missing array or a 0 means
+// the default: an 8 MB stack, the reference interpreter and no cap on the
+// heap. The engine is 't' for the threaded interpreter, 'r' for the
+// register tier or 'j' for the x86-64 jit. The heap cap is in bytes, a run
+// whose heap would need more fails.
+enum { BFCC_STACK, BFCC_ENGINE, BFCC_HEAP, BFCC_LIMITS };
+
+// compile the n bytes at source into a program, or print the error and
+// return 0. The program is never written to again, so any number of runs
+// may share it.
+long *bfcc_compile(char *source, long n);
+
+// run main() of program with argc and argv and return its exit status, or
+// -1 after printing a runtime error, like a stack overflow. Every run gets a fresh stack and a
+// copy-on-write view of the program's data segment, so that nothing it
+// does to its globals is seen by other runs.
+long bfcc_run(long *program, long argc, char **argv, long *limits);
+
+// free a program no run is using any more
+void bfcc_free(long *program);
+
+// green threads: a scheduler runs any number of runs, its tasks, on the
+// threads that serve it, each task for slice cycles at a time, or 10000
+// for 0, until its next call or backward jump, and then the next task in
+// its run queue. Tasks run on the threaded interpreter whatever the limits
+// say. A task's stack is address space that is only backed once written,
+// so a suspended task costs about the pages of stack and heap it has used.
+long *bfcc_sched(long slice);
+
+// add a run of program with argc and argv to sched, like bfcc_run() but
+// to be run by bfcc_serve(). Its exit status, or -1 after an error, goes
+// to *status when it ends, if status is not 0. argv must stay valid until
+// then. 0, or -1 if the task could not be set up.
+long bfcc_spawn(long *sched, long *program, long argc, char **argv,
+                long *limits, long *status);
+
+// run tasks of sched on the calling thread until every task has ended,
+// along with any other threads serving it
+void bfcc_serve(long *sched);
+
+// free a scheduler with no tasks left
+void bfcc_unsched(long *sched);
+
+#endif
@@ -0,0 +1,20 @@
+// branch targets inside sequences the peephole pass would otherwise fuse
+
+int main()
+{
+    int a, b, *p, i, s;
+    char *c;
+
+    a = 5;
+    b = 9;
+    p = &a;
+    s = 0;
+    i = 0;
+    while (i < 6) {
+        s = s + *(i & 1 ? &a : &b) + (i > 2 ? a : b) * 3 - (i ? i : 4);
+        i++;
+    }
+    c = "hello";
+    printf("%d %d %c %c\n", s, *p, c[i - 3], *(i > 3 ? c + 1 : c));
+    return s & 63;
+}
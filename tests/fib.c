@@ -0,0 +1,22 @@
+// recursion, string literals and char indexing
+
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+    char *s;
+
+    s = "hello";
+    i = 0;
+    while (i < 5) {
+        printf("%d %c\n", fib(i + 15), s[i]);
+        i++;
+    }
+    return fib(10) & 255;
+}
@@ -0,0 +1,27 @@
+// constant folding must not change what the program computes
+
+enum { K = 3, L = K * 4 + 1, M = (1 << L) - 1, N = -L, Z = !0 + ~0 };
+
+int main()
+{
+    int x, i, *p, s;
+    char *q;
+
+    x = 7;
+    p = malloc(16 * sizeof(int));
+    i = 0;
+    while (i < 16) {
+        p[i] = i * 3;
+        i++;
+    }
+    q = "abcdefgh";
+    s = 3 * 4 + x - (sizeof(char) << 3) + M % 100 + N + Z;
+    printf("%d %d %d %d %d\n", s, L, M, N, Z);
+    printf("%d %d %d %c %c\n", p[K + 2], *(p + 2 * 3), (p + 10) - p, q[L - 10], *(q + 2 + 1));
+    printf("%d %d %d %d %d\n", 1 && 2, 0 && 2, 0 || 5, 3 || 0, 7 / 2 == 3 ? 1 : 2);
+    printf("%d %d\n", sizeof(int) * 2 == sizeof(int) + sizeof(int), sizeof(int *) == sizeof(int));
+    // the least word over -1 does not fit: left to the runtime, never run
+    if (!x)
+        x = (1 << (sizeof(int) * 8 - 1)) / -1 + (1 << (sizeof(int) * 8 - 1)) % -1;
+    return -(x - 10) * - - 2;
+}
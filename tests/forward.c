@@ -0,0 +1,33 @@
+// calls to functions defined further down the file, resolved once the
+// whole file is parsed, also when a lexer thread feeds the parser (-L)
+
+int main()
+{
+    printf("%d %d\n", seven(3), odd(9));
+    return twice(seven(2));
+}
+
+int seven(int x)
+{
+    return x * 7;
+}
+
+// mutual recursion, each calling the other before it is defined
+int odd(int n)
+{
+    if (n == 0)
+        return 0;
+    return even(n - 1);
+}
+
+int even(int n)
+{
+    if (n == 0)
+        return 1;
+    return odd(n - 1);
+}
+
+int twice(int x)
+{
+    return x + x;
+}
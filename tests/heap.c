@@ -0,0 +1,47 @@
+// the VM heap: blocks of every size class and large ones, reused after
+// free(), with their contents intact while they are live
+
+int main()
+{
+    int **v, *p, i, n, bad, same;
+    char *big;
+
+    v = malloc(64 * sizeof(int));
+    bad = 0;
+    i = 0;
+    while (i < 64) {
+        n = (i * 37) % 5000 + 1;
+        v[i] = malloc(n);
+        memset((char *) v[i], i, n);
+        i++;
+    }
+    i = 0;
+    while (i < 64) {
+        n = (i * 37) % 5000 + 1;
+        if (((char *) v[i])[0] != i || ((char *) v[i])[n - 1] != i)
+            bad++;
+        i++;
+    }
+
+    // a freed block is the next one handed out of its class
+    p = v[10];
+    free(v[10]);
+    v[10] = malloc((10 * 37) % 5000 + 1);
+    same = v[10] == p;
+
+    // large blocks go back as soon as they are freed
+    big = malloc(1024 * 1024);
+    memset(big, 7, 1024 * 1024);
+    n = big[1024 * 1024 - 1];
+    free(big);
+
+    i = 0;
+    while (i < 64) {
+        free(v[i]);
+        i++;
+    }
+    free(v);
+    free(0);
+    printf("bad %d, reused %d, big %d\n", bad, same, n);
+    return bad;
+}
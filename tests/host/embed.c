@@ -0,0 +1,96 @@
+// libbfcc from a host program: one program compiled once and run many
+// times from several threads at once, on every engine. Each run must see
+// the initial globals and strings whatever the others write to theirs,
+// and a program that overflows its stack must only fail its own run.
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../bfcc.h"
+
+char *script =
+    "int count;\n"
+    "char *msg;\n"
+    "\n"
+    "int fib(int n)\n"
+    "{\n"
+    "    if (n < 2)\n"
+    "        return n;\n"
+    "    return fib(n - 1) + fib(n - 2);\n"
+    "}\n"
+    "\n"
+    "int main(int argc, char **argv)\n"
+    "{\n"
+    "    count = count + argc;\n"
+    "    msg = \"hello\";\n"
+    "    if (*msg != 'h')\n"
+    "        return -2;\n"
+    "    *msg = 'j';\n"
+    "    return count * 100 + fib(15);\n"
+    "}\n";
+
+char *runaway = "int f(int n) { return f(n + 1) + 1; }\n"
+                "int main() { return f(0); }\n";
+
+long *prog;
+long bad[4];
+
+void *worker(void *arg)
+{
+    char *argv[5] = { "a", "b", "c", "d", 0 };
+    long limits[BFCC_LIMITS], i, n, got;
+
+    n = (long) arg;
+    limits[BFCC_STACK] = 64 * 1024;
+    limits[BFCC_HEAP] = 0;
+    i = 0;
+    while (i < 200) {
+        limits[BFCC_ENGINE] = "\0trj"[i % 4];
+#if !defined(__x86_64__)
+        if (limits[BFCC_ENGINE] == 'j')
+            limits[BFCC_ENGINE] = 't';
+#endif
+        got = bfcc_run(prog, n + 1, argv, limits);
+        if (got != (n + 1) * 100 + 610)
+            bad[n]++;
+        i++;
+    }
+    return 0;
+}
+
+int main()
+{
+    pthread_t t[4];
+    long limits[BFCC_LIMITS], i, n;
+
+    if (bfcc_compile("int main() { return 1 +; }\n", 27))
+        printf("a bad program compiled\n");
+    if (!(prog = bfcc_compile(script, strlen(script))))
+        return 1;
+    for (i = 0; i < 4; i++)
+        pthread_create(&t[i], 0, worker, (void *) i);
+    n = 0;
+    for (i = 0; i < 4; i++) {
+        pthread_join(t[i], 0);
+        n = n + bad[i];
+    }
+    printf("800 runs on 4 threads, %ld wrong\n", n);
+    printf("one more: %ld\n", bfcc_run(prog, 1, 0, 0));
+    bfcc_free(prog);
+
+    // a stack overflow ends the run, not the host
+    if (!(prog = bfcc_compile(runaway, strlen(runaway))))
+        return 1;
+    limits[BFCC_STACK] = 16 * 1024;
+    limits[BFCC_HEAP] = 0;
+    for (i = 0; i < 4; i++) {
+        limits[BFCC_ENGINE] = "\0trj"[i];
+#if !defined(__x86_64__)
+        if (limits[BFCC_ENGINE] == 'j')
+            continue;
+#endif
+        printf("runaway: %ld\n", bfcc_run(prog, 1, 0, limits));
+    }
+    bfcc_free(prog);
+    return n != 0;
+}
@@ -0,0 +1,93 @@
+// libbfcc green threads: runs started on a scheduler take turns. On one
+// thread they go round robin in the order they were added, and thousands
+// of them at once, suspended most of the time, must all end with the
+// status of a run on its own, the one that overflows its stack included.
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../bfcc.h"
+
+char *turns = "int main(int argc, char **argv)\n"
+              "{\n"
+              "    int i, n;\n"
+              "\n"
+              "    i = 0;\n"
+              "    while (i < 3) {\n"
+              "        printf(\"%s%d \", argv[1], i);\n"
+              "        n = 1000;\n"
+              "        while (n)\n"
+              "            n--;\n"
+              "        i++;\n"
+              "    }\n"
+              "    return argc;\n"
+              "}\n";
+
+char *script = "int fib(int n)\n"
+               "{\n"
+               "    if (n < 2)\n"
+               "        return n;\n"
+               "    return fib(n - 1) + fib(n - 2);\n"
+               "}\n"
+               "\n"
+               "int main(int argc, char **argv)\n"
+               "{\n"
+               "    return argc * 100 + fib(12);\n"
+               "}\n";
+
+char *runaway = "int f(int n) { return f(n + 1) + 1; }\n"
+                "int main() { return f(0); }\n";
+
+enum { Ntask = 10000, Nthread = 4 };
+
+long *sched;
+long status[Ntask];
+
+void *server(void *arg)
+{
+    bfcc_serve(sched);
+    return 0;
+}
+
+int main()
+{
+    char *argv[3][3] = { { "t", "a", 0 }, { "t", "b", 0 }, { "t", "c", 0 } };
+    pthread_t t[Nthread];
+    long limits[BFCC_LIMITS], *prog, *bad, i, n;
+
+    // three runs on one thread, each yielding in every one of its loops
+    if (!(prog = bfcc_compile(turns, strlen(turns))) ||
+        !(sched = bfcc_sched(100)))
+        return 1;
+    for (i = 0; i < 3; i++)
+        bfcc_spawn(sched, prog, 2, argv[i], 0, status + i);
+    bfcc_serve(sched);
+    printf("\nstatus %ld %ld %ld\n", status[0], status[1], status[2]);
+    bfcc_free(prog);
+
+    // many more on a few threads, on small stacks, one of them runaway
+    if (!(prog = bfcc_compile(script, strlen(script))) ||
+        !(bad = bfcc_compile(runaway, strlen(runaway))))
+        return 1;
+    limits[BFCC_STACK] = 16 * 1024;
+    limits[BFCC_ENGINE] = 0;
+    limits[BFCC_HEAP] = 0;
+    for (i = 0; i < Ntask; i++) {
+        status[i] = -2;
+        if (bfcc_spawn(sched, i == Ntask / 2 ? bad : prog, i % 3 + 1,
+                       argv[0], limits, status + i))
+            return 1;
+    }
+    for (i = 0; i < Nthread; i++)
+        pthread_create(&t[i], 0, server, 0);
+    for (i = 0; i < Nthread; i++)
+        pthread_join(t[i], 0);
+    n = 0;
+    for (i = 0; i < Ntask; i++)
+        n = n + (status[i] != (i == Ntask / 2 ? -1 : (i % 3 + 1) * 100 + 144));
+    printf("%d tasks on %d threads, %ld wrong\n", Ntask, Nthread, n);
+    bfcc_unsched(sched);
+    bfcc_free(prog);
+    bfcc_free(bad);
+    return n != 0;
+}
@@ -0,0 +1,31 @@
+// Translation units linked together: calls across units and to functions
+// defined later in the same unit, globals shared by name, string literals
+// from every unit's data segment and tail calls into another unit.
+
+int count;
+char *banner;
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    banner = "link";
+    setup();
+    printf("%s: %d units, argc %d, argv[0] %s\n", banner, units(), argc,
+           *argv);
+    i = 0;
+    while (i < 6) {
+        printf("even(%d) = %d, odd(%d) = %d\n", i, even(i), i, odd(i));
+        i++;
+    }
+    printf("even(100001) = %d\n", even(100001));
+    printf("sum(1..100) = %d\n", sum(100, 0));
+    printf("%s\n", greeting());
+    printf("count = %d\n", count);
+    return later(7);
+}
+
+int later(int x)
+{
+    return x * 6;
+}
@@ -0,0 +1,18 @@
+// even() and odd() call each other across units, in tail position
+
+int count;
+
+int even(int n)
+{
+    count = count + 1;
+    if (n == 0)
+        return 1;
+    return odd(n - 1);
+}
+
+int sum(int n, int acc)
+{
+    if (n == 0)
+        return acc;
+    return sum(n - 1, acc + n);
+}
@@ -0,0 +1,30 @@
+// odd(), and globals and strings of a unit of its own
+
+enum { Units = 3 };
+
+int count;
+char *hello;
+
+int odd(int n)
+{
+    if (n == 0)
+        return 0;
+    return even(n - 1);
+}
+
+int setup()
+{
+    hello = "hello from util.c";
+    count = 0;
+    return 0;
+}
+
+int units()
+{
+    return Units;
+}
+
+char *greeting()
+{
+    return hello;
+}
@@ -0,0 +1,59 @@
+// bottom-tested loops, threaded jumps and compare-and-branch: comparisons
+// whose 0 or 1 is still used must keep it, the others may branch directly
+
+int calls;
+
+int lt(int a, int b)
+{
+    ++calls;
+    return a < b;
+}
+
+int main()
+{
+    int i, j, n, s, v, w;
+
+    // every comparison as a loop test, in both directions
+    s = 0;
+    i = 0;
+    while (i < 10) { s = s + i; i++; }
+    while (i > 0) { s = s + 1; i--; }
+    while (i <= 5) { s = s * 2 + i; i++; }
+    while (i >= 3) { s = s - i; i--; }
+    while (i != 8) { s = s + 3; i++; }
+    while (i == 8) { s = s + 100; i = 0; }
+    j = 0;
+    while (0) { s = 0; }
+    while (j < 3 && i < 2) { j++; i++; }
+    while (j < 5 || i < 4) { j++; i++; }
+    printf("%d %d %d\n", s, i, j);
+
+    // nested loops whose bodies end in if/else, so that their jumps land
+    // on the loop test
+    n = 0;
+    i = 0;
+    while (i < 20) {
+        j = i;
+        while (j > 0) {
+            if (j & 1)
+                n = n + j;
+            else
+                n = n - 1;
+            j = j - 3;
+        }
+        i++;
+    }
+    printf("%d\n", n);
+
+    // values of comparisons, && and || used as expressions
+    v = (3 < 4) + (4 < 3) * 10 + (5 == 5) * 100;
+    w = (i < 5 && j > 2) + (i > 5 || j < 2) * 2 + !(i != 20) * 4;
+    s = 0;
+    i = 0;
+    while (lt(i, 4) && lt(0, 1)) {
+        s = s + (i == 2 ? 10 : 1);
+        i++;
+    }
+    printf("%d %d %d %d\n", v, w, s, calls);
+    return (v + w + s) & 255;
+}
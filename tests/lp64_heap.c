@@ -0,0 +1,30 @@
+// 64-bit words only: a working set past the 2 GB a 32-bit word can index
+
+int main()
+{
+    char *p;
+    int n, i, s;
+
+    n = 3 * 1024 * 1024 * 1024;
+    if (!(p = malloc(n))) {
+        printf("malloc failed\n");
+        return 1;
+    }
+    i = 0;
+    while (i < n) {
+        p[i] = i >> 20;
+        i = i + 64 * 1024 * 1024;
+    }
+    p[n - 1] = 77;
+    s = 0;
+    i = 0;
+    while (i < n) {
+        s = s + p[i];
+        i = i + 64 * 1024 * 1024;
+    }
+    printf("%d %d %d\n", n >> 30, s, p[n - 1]);
+    // and words past 32 bits print whole, whatever the conversion
+    printf("%d %x %5u|%i\n", n, n, n - n + 7, -n);
+    free(p);
+    return 0;
+}
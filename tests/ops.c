@@ -0,0 +1,77 @@
+// every operator, globals, enums and the system calls
+
+enum { A = 3, B, C = 10 };
+
+int g;
+char *buf;
+
+int sum(int *v, int n)
+{
+    int s;
+
+    s = 0;
+    while (n) {
+        n--;
+        s = s + v[n];
+    }
+    return s;
+}
+
+int fact(int n)
+{
+    if (n <= 1)
+        return 1;
+    return n * fact(n - 1);
+}
+
+int main(int argc, char **argv)
+{
+    int *v, i, fd, x;
+    char *s, c;
+
+    v = malloc(10 * sizeof(int));
+    i = 0;
+    while (i < 10) {
+        v[i] = i * i - 7;
+        ++i;
+    }
+    printf("sum %d fact %d\n", sum(v, 10), fact(10));
+    printf("ops %d %d %d %d %d\n", -17 / 5, -17 % 5, 1 << 10, -64 >> 3, 6 | 9 & 3);
+    printf("cmp %d %d %d %d %d\n", 1 < 2, 2 <= 2, 3 > 4, 4 >= 5, (5 == 5) + (5 != 5) * 2);
+    printf("log %d %d %d %d %d\n", 1 && 0, 0 || 3, !7, ~5, 5 ^ 3);
+    printf("cond %d %d enum %d %d %d\n", i > 5 ? 100 : 200, i < 5 ? 100 : 200, A, B, C);
+    g = 42;
+    x = g--;
+    printf("glob %d %d %d\n", g, x, g++ + ++g);
+    s = malloc(16);
+    memset(s, 'a', 15);
+    s[15] = 0;
+    s[3] = 'x';
+    c = s[3];
+    printf("str %s %c %d\n", s, c, memcmp(s, "aaax", 4));
+    buf = s;
+    *buf = 'Z';
+    printf("ptr %c %d\n", *s, &v[7] - v);
+    free(s);
+    free(v);
+    fd = open("ops.c", 0);
+    s = malloc(32);
+    i = read(fd, s, 10);
+    s[i] = 0;
+    close(fd);
+    printf("read %d [%s]\n", i, s);
+    i = 0;
+    x = 0;
+    while (i < 100) {
+        if (i % 3 == 0)
+            x = x + i;
+        else if (i % 5 == 0)
+            x = x - 1;
+        else
+            x = x ^ i;
+        i++;
+    }
+    printf("loop %d\n", x);
+    exit(x % 7);
+    return 1;
+}
@@ -0,0 +1,100 @@
+// -O rebuilds every function as trees: dead stores, code after return,
+// expressions computed twice in a block and loop invariants must all go
+// without changing what the program computes
+
+int g;
+
+int side(int x)
+{
+    g = g + x;
+    return x;
+}
+
+// the store to t is dead, the one to u is read through its address
+int stores(int a)
+{
+    int t, u, *p;
+
+    t = a * 5;
+    t = side(a) + 1;
+    p = &u;
+    u = 4;
+    *p = *p + t;
+    t = a;
+    return u;
+    t = 99;
+    side(1000);
+    return t;
+}
+
+// the address of p[i] and the sum a + b are each computed once
+int common(int *p, int i, int a, int b)
+{
+    int s;
+
+    s = p[i + 1] * 2 + p[i + 1];
+    p[i + 1] = (a + b) * (a - b);
+    s = s + p[i + 1] + (a + b) * (a - b);
+    return s;
+}
+
+// n * 4 + k and q + n do not change in the inner loop, i * n only in it
+int invariant(int n, int k, char *q)
+{
+    int i, j, s;
+
+    s = 0;
+    i = 0;
+    while (i < n) {
+        j = 0;
+        while (j < n) {
+            s = s + n * 4 + k + i * n + *(q + n - j - 1);
+            j++;
+        }
+        i++;
+    }
+    // a store in the loop keeps it there
+    i = 0;
+    while (i < 3) {
+        s = s + (k * 7 - 1);
+        k = k + 1;
+        i++;
+    }
+    // so does a division, that could trap
+    i = 0;
+    while (i < n) {
+        if (k) {
+            s = s + 100 / k;
+        }
+        i++;
+    }
+    return s;
+}
+
+// ++ reads the address it pushed again, the stores around it stay
+int bump(int *p)
+{
+    int x, y;
+
+    x = 1;
+    y = x++ + ++x;
+    p[1]++;
+    ++*p;
+    return x * 10 + y;
+}
+
+int main()
+{
+    int *p;
+
+    p = malloc(4 * sizeof(int));
+    p[0] = 1;
+    p[1] = 2;
+    p[2] = 3;
+    p[3] = 4;
+    printf("%d %d\n", stores(6), g);
+    printf("%d\n", common(p, 1, 5, 2));
+    printf("%d\n", invariant(4, 3, "abcd"));
+    printf("%d %d %d\n", bump(p), p[0], p[1]);
+    return g;
+}
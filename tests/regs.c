@@ -0,0 +1,55 @@
+// shapes the register tier translates specially: values joined by ?:,
+// && and ||, nested calls as arguments, stores through pointers while
+// reads of the same variable are pending, char and global stores
+
+int g;
+char gc;
+
+int add3(int a, int b, int c)
+{
+    return a * 100 + b * 10 + c;
+}
+
+int bump(int *p)
+{
+    *p = *p + 1;
+    return *p;
+}
+
+int main()
+{
+    int i, j, *p;
+    char c, *s;
+
+    i = 3;
+    j = 4;
+    printf("%d %d %d\n", i < j ? i : j, i && j, i || 0);
+    printf("%d %d\n", 0 && j, (i > j) || (j - 4));
+    printf("%d\n", add3(i, add3(1, 2, 3) % 10, i ? j : 7));
+    printf("%d\n", 10 - i + (5 - j) * 2);
+    printf("%d %d\n", i++ + j--, i * 10 + j);
+
+    // the pending read of i happens before the call changes it
+    printf("%d\n", i + bump(&i) * 100);
+    p = &j;
+    *p = i + j;
+    printf("%d %d\n", j, *p << 1);
+
+    g = 40;
+    g = g + 2;
+    gc = c = 300;
+    s = &c;
+    *s = *s + 1;
+    printf("%d %d %d\n", g, gc, c);
+
+    i = 0;
+    j = 0;
+    while (i < 10) {
+        if (i & 1)
+            j = j + i;
+        else if (i == 4 || i == 6)
+            j = j - 1;
+        ++i;
+    }
+    return j + (i == 10 ? 100 : 0);
+}
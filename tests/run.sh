@@ -0,0 +1,223 @@
+#!/bin/sh
+# Regression suite: build bfcc for every VM word width the host compiler
+# can target, run each test program through every engine and compare its
+# output and exit status with the matching .expect file.
+#
+#   tests/run.sh            run the suite
+#   tests/run.sh -update    rewrite the .expect files from the native build
+#
+# lp64_*.c programs need a 64-bit word and are skipped for 32-bit builds.
+# A directory is one program made of all the translation units in it,
+# except host/, whose programs are host C that embeds libbfcc.
+
+cd "$(dirname "$0")" || exit 1
+CC=${CC:-cc}
+tmp=${TMPDIR:-/tmp}/bfcc-tests.$$
+mkdir -p "$tmp/cache"
+trap 'rm -rf "$tmp"' EXIT
+
+fail=0
+pass=0
+for flags in "" -m32; do
+    if ! $CC $flags -O2 -w -pthread -o "$tmp/bfcc" ../bfcc.c 2>/dev/null; then
+        echo "skip: $CC $flags cannot build bfcc"
+        continue
+    fi
+    echo 'int main() { return sizeof(int) * 8; }' > "$tmp/word.c"
+    "$tmp/bfcc" "$tmp/word.c" > /dev/null
+    width=$?
+    echo "word: $width bits ($CC $flags)"
+    # the cache mode runs twice: a miss that compiles, then a hit that loads
+    modes="- -t -r -O -O,-t -O,-r -L -L,-O,-r -C,$tmp/cache -C,$tmp/cache"
+    if [ $width = 64 ] && [ "$(uname -m)" = x86_64 ]; then
+        modes="$modes -j -O,-j"
+    fi
+    for t in *.c */; do
+        case $t in
+        lp64_*) [ $width = 64 ] || continue ;;
+        host/) continue ;;
+        esac
+        case $t in
+        */) in="$t*.c --" x=${t%/} ;;
+        *) in=$t x=${t%.c} ;;
+        esac
+        for m in $modes; do
+            args=$(echo "$m" | tr ',' ' ')
+            [ "$args" = - ] && args=
+            # drop the VM's own exit/cycle line, keep the status
+            { "$tmp/bfcc" $args $in; echo "status $?"; } 2>&1 |
+                grep -v '^exit(' > "$tmp/out"
+            if [ "$1" = -update ] && [ -z "$flags" ] && [ "$m" = - ]; then
+                cp "$tmp/out" "$x.expect"
+            fi
+            if cmp -s "$tmp/out" "$x.expect"; then
+                pass=$((pass + 1))
+            else
+                echo "FAIL: $t ($width-bit word, mode $args)"
+                diff "$x.expect" "$tmp/out" | head -10
+                fail=$((fail + 1))
+            fi
+        done
+    done
+
+    # -R runs all the single file programs at once on a pool of threads,
+    # with -T as tasks that take turns every few cycles, the status each
+    # one ends with must match its .expect file
+    progs=
+    for t in *.c; do
+        case $t in lp64_*) [ $width = 64 ] || continue ;; esac
+        progs="$progs $t"
+    done
+    for r in "-R 3" "-R 3 -T 100"; do
+        "$tmp/bfcc" $r $progs 2>&1 | grep ': exit(' | tr -d '():' > "$tmp/pool"
+        for t in $progs; do
+            got=$(awk -v t=$t '$1 == t { print $2 }' "$tmp/pool" |
+                sed 's/^exit//')
+            if [ -n "$got" ] &&
+                [ "status $((got & 255))" = "$(tail -1 "${t%.c}.expect")" ]
+            then
+                pass=$((pass + 1))
+            else
+                echo "FAIL: $t ($width-bit word, $r, exit '$got')"
+                fail=$((fail + 1))
+            fi
+        done
+    done
+
+    # runaway recursion hits the guard page below the stack: every engine
+    # reports where, and under -R only that program fails
+    printf '%s\n' 'int down(int n) { return down(n + 1) + 1; }' \
+        'int main() { return down(0); }' > "$tmp/deep.c"
+    for m in $modes; do
+        args=$(echo "$m" | tr ',' ' ')
+        [ "$args" = - ] && args=
+        if "$tmp/bfcc" -S 64k $args "$tmp/deep.c" 2>&1 |
+            grep -q '^stack overflow at pc [0-9]*'; then
+            pass=$((pass + 1))
+        else
+            echo "FAIL: stack overflow ($width-bit word, mode $args)"
+            fail=$((fail + 1))
+        fi
+    done
+    for r in "-R 2" "-R 2 -T 100"; do
+        if "$tmp/bfcc" $r -S 64k "$tmp/deep.c" fib.c 2>&1 |
+            grep -q '^fib.c: exit(55)$'; then
+            pass=$((pass + 1))
+        else
+            echo "FAIL: stack overflow ($width-bit word, $r)"
+            fail=$((fail + 1))
+        fi
+    done
+
+    # a heap cap ends the program that goes past it
+    if "$tmp/bfcc" -M 256k heap.c 2>&1 | grep -q '^heap cap of 262144 bytes'
+    then
+        pass=$((pass + 1))
+    else
+        echo "FAIL: heap cap ($width-bit word)"
+        fail=$((fail + 1))
+    fi
+
+    # -F: sampled stacks, folded, run from main into the loop that takes
+    # the time, each frame on its line
+    printf '%s\n' 'int spin(int n)' '{' '    while (n) {' '        n--;' \
+        '    }' '    return n;' '}' 'int main()' '{' '    return spin(30000000);' \
+        '}' > "$tmp/spin.c"
+    fmodes="- -O"
+    if [ $width = 64 ] && [ "$(uname -m)" = x86_64 ]; then
+        fmodes="$fmodes -j"
+    fi
+    for m in $fmodes; do
+        [ $m = - ] && m=
+        rm -f "$tmp/folded"
+        "$tmp/bfcc" $m -F "$tmp/folded" "$tmp/spin.c" > /dev/null
+        if grep -q '^main:10;spin:[34] [0-9]*$' "$tmp/folded" &&
+            ! grep -qv '^main:10;spin:[0-9]* [0-9]*$' "$tmp/folded"; then
+            pass=$((pass + 1))
+        else
+            echo "FAIL: sampled stacks ($width-bit word, mode $m)"
+            head -5 "$tmp/folded"
+            fail=$((fail + 1))
+        fi
+    done
+
+    # -j: a program whose code is many pages long, well past the slack of
+    # the jit code area, must run as it does on the interpreter
+    if [ $width = 64 ] && [ "$(uname -m)" = x86_64 ]; then
+        {
+            echo 'int pad(int x)'
+            echo '{'
+            i=1
+            while [ $i -le 600 ]; do
+                echo "    x = (x ^ $i) + (x >> 3);"
+                i=$((i + 1))
+            done
+            echo '    return x;'
+            echo '}'
+            echo 'int main()'
+            echo '{'
+            echo '    printf("%d\n", pad(1));'
+            echo '    return 0;'
+            echo '}'
+        } > "$tmp/big.c"
+        "$tmp/bfcc" "$tmp/big.c" 2>&1 | grep -v '^exit(' > "$tmp/big"
+        for m in -j -O,-j; do
+            args=$(echo "$m" | tr ',' ' ')
+            "$tmp/bfcc" $args "$tmp/big.c" 2>&1 | grep -v '^exit(' > "$tmp/out"
+            if [ -s "$tmp/big" ] && cmp -s "$tmp/out" "$tmp/big"; then
+                pass=$((pass + 1))
+            else
+                echo "FAIL: large program ($width-bit word, mode $args)"
+                diff "$tmp/big" "$tmp/out" | head -10
+                fail=$((fail + 1))
+            fi
+        done
+    fi
+
+    # -A: the program as x86-64 assembly, linked by the host compiler into
+    # an executable that must behave like the VM, its exit line aside
+    if [ $width = 64 ] && [ "$(uname -m)" = x86_64 ]; then
+        for t in *.c; do
+            for m in "" -O; do
+                if "$tmp/bfcc" $m -A "$tmp/prog.s" $t &&
+                    $CC -o "$tmp/prog" "$tmp/prog.s"; then
+                    { "$tmp/prog"; echo "status $?"; } > "$tmp/out" 2>&1
+                else
+                    echo "no executable" > "$tmp/out"
+                fi
+                if cmp -s "$tmp/out" "${t%.c}.expect"; then
+                    pass=$((pass + 1))
+                else
+                    echo "FAIL: $t (native $m)"
+                    diff "${t%.c}.expect" "$tmp/out" | head -10
+                    fail=$((fail + 1))
+                fi
+            done
+        done
+    fi
+
+    # libbfcc: bfcc.c without main(), with only its bfcc_* symbols global
+    if ! $CC $flags -O2 -w -pthread -DBFCC_LIB -c -o "$tmp/lib.o" ../bfcc.c ||
+        ! objcopy -w --keep-global-symbol='bfcc_*' "$tmp/lib.o" \
+            "$tmp/libbfcc.o"; then
+        echo "skip: cannot build libbfcc ($CC $flags)"
+        continue
+    fi
+    for t in host/*.c; do
+        $CC $flags -O2 -w -pthread -o "$tmp/host" "$t" "$tmp/libbfcc.o"
+        { "$tmp/host"; echo "status $?"; } > "$tmp/out" 2>&1
+        if [ "$1" = -update ] && [ -z "$flags" ]; then
+            cp "$tmp/out" "${t%.c}.expect"
+        fi
+        if cmp -s "$tmp/out" "${t%.c}.expect"; then
+            pass=$((pass + 1))
+        else
+            echo "FAIL: $t ($width-bit word)"
+            diff "${t%.c}.expect" "$tmp/out" | head -10
+            fail=$((fail + 1))
+        fi
+    done
+done
+
+echo "$pass passed, $fail failed"
+[ $fail = 0 ]
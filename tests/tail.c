@@ -0,0 +1,96 @@
+// calls in tail position reuse the caller's frame: these recurse far
+// deeper than the VM stack could hold frames for
+
+int sum(int n, int acc)
+{
+    if (n == 0)
+        return acc;
+    return sum(n - 1, acc + n);
+}
+
+int parity(int n, int p)
+{
+    if (n == 0)
+        return p;
+    return parity(n - 1, !p);
+}
+
+// fewer arguments than parameters, and a call with zero arguments
+int left;
+
+int tick()
+{
+    if (--left <= 0)
+        return 7;
+    return tick();
+}
+
+int fewer(int a, int b, int c)
+{
+    left = a + b + c;
+    return tick();
+}
+
+// more arguments than parameters stay an ordinary call
+int three(int a, int b, int c)
+{
+    return a * 100 + b * 10 + c;
+}
+
+int more(int a)
+{
+    return three(a, a + 1, a + 2);
+}
+
+// tail calls in both arms of ?: and behind &&
+int pick(int n)
+{
+    return n > 5 ? sum(n, 0) : parity(n, 0);
+}
+
+int both(int n)
+{
+    return n && parity(n, 1);
+}
+
+// a call that may read this frame through a pointer into it stays an
+// ordinary call: the callee's frame would take the place of this one
+int deref(int *p)
+{
+    int y;
+
+    y = 7;
+    return *p + y;
+}
+
+int local(int a)
+{
+    int x;
+
+    x = 5;
+    return deref(&x);
+}
+
+int param(int a)
+{
+    return deref(&a);
+}
+
+int through(int a)
+{
+    int x, *q;
+
+    x = 5;
+    q = &x;
+    return deref(q);
+}
+
+int main()
+{
+    printf("%d\n", sum(3000000, 0) % 1000000);
+    printf("%d %d\n", parity(2000001, 0), parity(2000000, 0));
+    printf("%d %d\n", fewer(1000000, 2, 3), more(1));
+    printf("%d %d %d %d\n", pick(10), pick(3), both(0), both(4));
+    printf("%d %d %d\n", local(0), param(30), through(0));
+    return 0;
+}
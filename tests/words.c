@@ -0,0 +1,29 @@
+// pointers stored in int words must survive the round trip unchanged
+
+int *cell;
+
+int main()
+{
+    int *v, i, w, **pp;
+    char *s, *t;
+
+    v = malloc(8 * sizeof(int));
+    i = 0;
+    while (i < 8) {
+        v[i] = (int) (v + i);
+        i++;
+    }
+    i = 0;
+    w = 0;
+    while (i < 8) {
+        if ((int *) v[i] == &v[i])
+            w++;
+        i++;
+    }
+    cell = v + 3;
+    pp = &cell;
+    s = "pointer";
+    t = (char *) (int) s;
+    printf("%d %d %d %s\n", w, *pp - v, (int) &v[5] - (int) v == 5 * sizeof(int), t + 2);
+    return *pp == v + 3;
+}
@@ -0,0 +1,40 @@
+// write() and printf() share one output buffer and must stay in order
+
+int main()
+{
+    char *b;
+    int i, n, fd;
+
+    b = malloc(70000);
+    i = 0;
+    while (i < 26) {
+        b[i] = 'a' + i;
+        i++;
+    }
+    b[26] = '\n';
+    n = write(1, b, 27);
+    printf("wrote %d\n", n);
+    i = 0;
+    while (i < 5) {
+        write(1, b + i, 1);
+        printf("%d", i);
+        i++;
+    }
+    write(1, "\n", 1);
+    n = write(1, b, 0);
+
+    // larger than the buffer: goes straight to the fd after a flush
+    memset(b, 'x', 70000);
+    fd = open("/dev/null", 1);
+    n = n + write(fd, b, 70000);
+    close(fd);
+    printf("big %d\n", n);
+    b[68] = '\n';
+    i = 0;
+    while (i < 300) {
+        n = n + write(1, b + 68 - i % 69, i % 69 + 1);
+        i++;
+    }
+    printf("total %d\n", n);
+    return n % 256;
+}